@@ -24,5 +24,32 @@ LOCAL_SHARED_LIBRARIES := libbinder
 LOCAL_SRC_FILES := \
     aidl/yudatun/product/smartcar/ISmartCarService.aidl \
     binder_constants.cpp \
+    flight_recorder.cpp \
+    metrics.cpp \
 
 include $(BUILD_STATIC_LIBRARY)
+
+# Host-side flight recorder dump decoder
+# ========================================================
+include $(CLEAR_VARS)
+LOCAL_MODULE := smartcar_flight_decoder
+LOCAL_CLANG := true
+LOCAL_CFLAGS := -Wall -Werror
+
+LOCAL_SRC_FILES := \
+    flight_recorder.cpp \
+    flight_recorder_decoder.cpp \
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Host-side metrics scraper
+# ========================================================
+include $(CLEAR_VARS)
+LOCAL_MODULE := smartcar_metrics_scraper
+LOCAL_CLANG := true
+LOCAL_CFLAGS := -Wall -Werror
+
+LOCAL_SRC_FILES := \
+    metrics_scraper.cpp \
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -23,4 +23,10 @@ const int kRightFrontWheelPin = 12;
 const int kLeftAfterWheelPin  = 13;
 const int kRightAfterWheelPin = 16;
 
+const char kEncoderGpioChip[] = "/dev/gpiochip0";
+const int kLeftFrontEncoderPin  = 5;
+const int kRightFrontEncoderPin = 6;
+const int kLeftAfterEncoderPin  = 19;
+const int kRightAfterEncoderPin = 26;
+
 }  // namespace smartcard
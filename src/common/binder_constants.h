@@ -24,6 +24,15 @@ extern const int kRightFrontWheelPin;
 extern const int kLeftAfterWheelPin;
 extern const int kRightAfterWheelPin;
 
+// Wheel encoder inputs, in the same order as the wheels above. These are
+// line offsets on kEncoderGpioChip, which on the boards we ship match
+// the sysfs GPIO numbers.
+extern const char kEncoderGpioChip[];
+extern const int kLeftFrontEncoderPin;
+extern const int kRightFrontEncoderPin;
+extern const int kLeftAfterEncoderPin;
+extern const int kRightAfterEncoderPin;
+
 }  // namespace smartcard
 
 #endif  // SRC_COMMON_BINDER_CONSTANTS_H_
@@ -0,0 +1,160 @@
+// Copyright 2016 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "flight_recorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace smartcard {
+
+namespace {
+
+const int kFatalSignals[] = { SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV };
+
+// Whatever was installed before us, typically debuggerd's handler.
+struct sigaction g_previous_actions[NSIG];
+
+uint64_t NowNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+bool WriteFully(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        p += written;
+        size -= written;
+    }
+    return true;
+}
+
+void OnDumpSignal(int) {
+    int saved_errno = errno;
+    FlightRecorder* recorder = FlightRecorder::Get();
+    recorder->DumpToFile(recorder->dump_path());
+    errno = saved_errno;
+}
+
+void OnFatalSignal(int signo, siginfo_t* info, void* context) {
+    static int dumped = 0;
+    if (!__atomic_exchange_n(&dumped, 1, __ATOMIC_SEQ_CST)) {
+        FlightRecorder* recorder = FlightRecorder::Get();
+        recorder->DumpToFile(recorder->dump_path());
+    }
+
+    // Hand the signal on to the previous handler as if we had never been
+    // installed, so debuggerd still gets its tombstone.
+    const struct sigaction& previous = g_previous_actions[signo];
+    if (previous.sa_flags & SA_RESETHAND)
+        sigaction(signo, &previous, nullptr);
+    if (previous.sa_flags & SA_SIGINFO) {
+        previous.sa_sigaction(signo, info, context);
+        return;
+    }
+    if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+        previous.sa_handler(signo);
+        return;
+    }
+
+    // Nobody else wants it; die the default way once we return and the
+    // signal is unblocked. A fatal fault cannot usefully be ignored.
+    struct sigaction fallback = {};
+    sigemptyset(&fallback.sa_mask);
+    fallback.sa_handler = SIG_DFL;
+    sigaction(signo, &fallback, nullptr);
+    raise(signo);
+}
+
+}  // namespace
+
+const char* FlightEventName(uint16_t event) {
+    switch (static_cast<FlightEvent>(event)) {
+        case FlightEvent::kCommandReceived: return "command_received";
+        case FlightEvent::kActionTick:      return "action_tick";
+        case FlightEvent::kWheelWrite:      return "wheel_write";
+        case FlightEvent::kBinderError:     return "binder_error";
+        case FlightEvent::kLeaseExpired:    return "lease_expired";
+    }
+    return "unknown";
+}
+
+FlightRecorder* FlightRecorder::Get() {
+    static FlightRecorder recorder;
+    return &recorder;
+}
+
+void FlightRecorder::Record(FlightEvent event, uint16_t arg0, int64_t arg1) {
+    uint64_t sequence =
+        __atomic_add_fetch(&next_sequence_, 1, __ATOMIC_RELAXED);
+    FlightRecord& record = records_[(sequence - 1) & (kCapacity - 1)];
+
+    // Mark the slot torn while it is rewritten, publish it afterwards.
+    __atomic_store_n(&record.sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record.timestamp_ns = NowNanoseconds();
+    record.event = static_cast<uint16_t>(event);
+    record.arg0 = arg0;
+    record.arg1 = arg1;
+    __atomic_store_n(&record.sequence, sequence, __ATOMIC_RELEASE);
+}
+
+bool FlightRecorder::DumpToFile(const char* path) const {
+    if (!path || !path[0])
+        return false;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fd < 0)
+        return false;
+
+    FlightRecorderHeader header = {};
+    header.magic = kFlightRecorderMagic;
+    header.version = kFlightRecorderVersion;
+    header.record_size = sizeof(FlightRecord);
+    header.capacity = kCapacity;
+    header.next_sequence = __atomic_load_n(&next_sequence_, __ATOMIC_ACQUIRE);
+    header.dump_time_ns = NowNanoseconds();
+
+    bool ok = WriteFully(fd, &header, sizeof(header)) &&
+              WriteFully(fd, records_, sizeof(records_));
+    close(fd);
+    return ok;
+}
+
+void FlightRecorder::InstallSignalHandlers(const char* path) {
+    strncpy(dump_path_, path, sizeof(dump_path_) - 1);
+
+    struct sigaction action = {};
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = OnDumpSignal;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &action, nullptr);
+
+    action.sa_sigaction = OnFatalSignal;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    for (int signo : kFatalSignals)
+        sigaction(signo, &action, &g_previous_actions[signo]);
+}
+
+}  // namespace smartcard
@@ -0,0 +1,94 @@
+// Copyright 2016 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_COMMON_FLIGHT_RECORDER_H_
+#define SRC_COMMON_FLIGHT_RECORDER_H_
+
+#include <stdint.h>
+
+namespace smartcard {
+
+enum class FlightEvent : uint16_t {
+    kCommandReceived = 1,  // arg0: unused, arg1: payload size
+    kActionTick      = 2,  // arg0: unused, arg1: tick number
+    kWheelWrite      = 3,  // arg0: pin,    arg1: value written
+    kBinderError     = 4,  // arg0: pin/0,  arg1: exception code
+    kLeaseExpired    = 5,  // arg0: unused, arg1: stop latency in ns
+};
+
+// Returns a printable name for |event|, "unknown" if it is not one above.
+const char* FlightEventName(uint16_t event);
+
+// One slot of the ring, dumped to disk as is.
+struct FlightRecord {
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC
+    uint64_t sequence;      // 1-based, 0 while the slot is being written
+    int64_t  arg1;
+    uint16_t event;
+    uint16_t arg0;
+    uint32_t reserved;
+};
+static_assert(sizeof(FlightRecord) == 32, "FlightRecord layout changed");
+
+// Header of a dump file, followed by |capacity| FlightRecords.
+struct FlightRecorderHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t capacity;
+    uint32_t reserved;
+    uint64_t next_sequence;
+    uint64_t dump_time_ns;
+};
+
+const uint32_t kFlightRecorderMagic = 0x52464353;  // "SCFR"
+// Version 1 had a 32-bit sequence, which wrapped after 2^32 events.
+const uint16_t kFlightRecorderVersion = 2;
+
+// Fixed-size, lock-free ring of binary events. Recording is a fetch_add and
+// a few stores, cheap enough to leave on for every GPIO write; the ring is
+// only written out when something goes wrong.
+class FlightRecorder final {
+ public:
+    static const uint32_t kCapacity = 4096;  // power of two
+
+    // Process-wide recorder.
+    static FlightRecorder* Get();
+
+    void Record(FlightEvent event, uint16_t arg0, int64_t arg1);
+
+    // Writes the ring to |path|. Async-signal-safe.
+    bool DumpToFile(const char* path) const;
+
+    // Dumps to |path| on SIGUSR2 and on fatal signals. Fatal signals are
+    // then passed to the handlers installed before, e.g. debuggerd's, or
+    // get their default action if there were none.
+    void InstallSignalHandlers(const char* path);
+
+    const char* dump_path() const { return dump_path_; }
+
+ private:
+    FlightRecorder() = default;
+
+    FlightRecord records_[kCapacity] = {};
+    uint64_t next_sequence_{0};
+    char dump_path_[128] = {};
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+};
+
+}  // namespace smartcard
+
+#endif  // SRC_COMMON_FLIGHT_RECORDER_H_
@@ -0,0 +1,82 @@
+// Copyright 2016 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host-side decoder for flight recorder dumps pulled off a device:
+//
+//   adb pull /data/misc/smartcar/smartcard.flight
+//   smartcar_flight_decoder smartcard.flight
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "flight_recorder.h"
+
+using smartcard::FlightEventName;
+using smartcard::FlightRecord;
+using smartcard::FlightRecorderHeader;
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <dump file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (!file) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    FlightRecorderHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != smartcard::kFlightRecorderMagic ||
+        header.version != smartcard::kFlightRecorderVersion ||
+        header.record_size != sizeof(FlightRecord)) {
+        fprintf(stderr, "%s: not a flight recorder dump\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    std::vector<FlightRecord> records(header.capacity);
+    size_t count = fread(records.data(), sizeof(FlightRecord),
+                         records.size(), file);
+    fclose(file);
+    records.resize(count);
+
+    // Drop empty and torn slots, then put the rest back in order.
+    records.erase(
+        std::remove_if(records.begin(), records.end(),
+                       [](const FlightRecord& r) { return r.sequence == 0; }),
+        records.end());
+    std::sort(records.begin(), records.end(),
+              [](const FlightRecord& a, const FlightRecord& b) {
+                  return a.sequence < b.sequence;
+              });
+
+    printf("# %" PRIu64 " events recorded, %zu kept\n",
+           header.next_sequence, records.size());
+    printf("# %10s %14s  %-18s %6s %s\n",
+           "sequence", "ms_before_dump", "event", "arg0", "arg1");
+    for (const FlightRecord& r : records) {
+        double ms_before_dump =
+            (static_cast<int64_t>(header.dump_time_ns - r.timestamp_ns)) / 1e6;
+        printf("  %10" PRIu64 " %14.3f  %-18s %6u %" PRId64 "\n",
+               r.sequence, ms_before_dump, FlightEventName(r.event),
+               r.arg0, r.arg1);
+    }
+    return 0;
+}
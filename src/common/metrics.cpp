@@ -0,0 +1,298 @@
+// Copyright 2016 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "metrics.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace smartcard {
+
+namespace {
+
+int64_t NowNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Appends |name|{|labels|,|extra|} |value| as one exposition line.
+void AppendSample(std::string* out, const std::string& name,
+                  const std::string& labels, const char* extra,
+                  const char* value) {
+    out->append(name);
+    if (!labels.empty() || extra) {
+        out->append("{");
+        out->append(labels);
+        if (!labels.empty() && extra)
+            out->append(",");
+        if (extra)
+            out->append(extra);
+        out->append("}");
+    }
+    out->append(" ");
+    out->append(value);
+    out->append("\n");
+}
+
+void AppendHeader(std::string* out, const std::string& name,
+                  const std::string& help, const char* type) {
+    out->append("# HELP " + name + " " + help + "\n");
+    out->append("# TYPE " + name + " " + type + "\n");
+}
+
+int64_t GetResidentBytes() {
+    FILE* statm = fopen("/proc/self/statm", "re");
+    if (!statm)
+        return 0;
+    long size = 0;
+    long resident = 0;
+    int fields = fscanf(statm, "%ld %ld", &size, &resident);
+    fclose(statm);
+    return fields == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+// Scrapers that stop reading get dropped after this long.
+const time_t kSendTimeoutSeconds = 1;
+
+// MSG_NOSIGNAL: a scraper hanging up early must not SIGPIPE the daemon.
+bool SendFully(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+}  // namespace
+
+const size_t LatencyHistogram::kBucketCount;
+const int64_t LatencyHistogram::kBucketBoundsUs[kBucketCount] = {
+    10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000,
+};
+
+void LatencyHistogram::Observe(int64_t latency_ns) {
+    int64_t latency_us = latency_ns / 1000;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        if (latency_us <= kBucketBoundsUs[i]) {
+            buckets_[i].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(latency_ns, std::memory_order_relaxed);
+}
+
+ScopedLatency::ScopedLatency(LatencyHistogram* histogram)
+    : histogram_{histogram}, start_ns_{NowNanoseconds()} {
+}
+
+ScopedLatency::~ScopedLatency() {
+    histogram_->Observe(NowNanoseconds() - start_ns_);
+}
+
+MetricsRegistry* MetricsRegistry::Get() {
+    static MetricsRegistry registry;
+    return &registry;
+}
+
+Counter* MetricsRegistry::AddCounter(const std::string& name,
+                                     const std::string& help,
+                                     const std::string& labels) {
+    Entry* entry = AddEntry(Type::kCounter, name, help, labels);
+    entry->counter.reset(new Counter);
+    return entry->counter.get();
+}
+
+Gauge* MetricsRegistry::AddGauge(const std::string& name,
+                                 const std::string& help,
+                                 const std::string& labels) {
+    Entry* entry = AddEntry(Type::kGauge, name, help, labels);
+    entry->gauge.reset(new Gauge);
+    return entry->gauge.get();
+}
+
+LatencyHistogram* MetricsRegistry::AddHistogram(const std::string& name,
+                                                const std::string& help,
+                                                const std::string& labels) {
+    Entry* entry = AddEntry(Type::kHistogram, name, help, labels);
+    entry->histogram.reset(new LatencyHistogram);
+    return entry->histogram.get();
+}
+
+MetricsRegistry::Entry* MetricsRegistry::AddEntry(
+    Type type, const std::string& name, const std::string& help,
+    const std::string& labels) {
+    std::unique_ptr<Entry> entry{new Entry};
+    entry->type = type;
+    entry->name = name;
+    entry->help = help;
+    entry->labels = labels;
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    entries_.push_back(std::move(entry));
+    return entries_.back().get();
+}
+
+std::string MetricsRegistry::Render() const {
+    std::string out;
+    char value[32];
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpu_seconds =
+        usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    AppendHeader(&out, "process_cpu_seconds_total",
+                 "User and system CPU time spent in seconds.", "counter");
+    snprintf(value, sizeof(value), "%.6f", cpu_seconds);
+    AppendSample(&out, "process_cpu_seconds_total", "", nullptr, value);
+
+    AppendHeader(&out, "process_resident_memory_bytes",
+                 "Resident memory size in bytes.", "gauge");
+    snprintf(value, sizeof(value), "%lld",
+             static_cast<long long>(GetResidentBytes()));
+    AppendSample(&out, "process_resident_memory_bytes", "", nullptr, value);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    std::vector<bool> rendered(entries_.size(), false);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (rendered[i])
+            continue;
+        const Entry& first = *entries_[i];
+        AppendHeader(&out, first.name, first.help,
+                     first.type == Type::kCounter ? "counter" :
+                     first.type == Type::kGauge ? "gauge" : "histogram");
+
+        // Every entry of the family goes right under its header.
+        for (size_t j = i; j < entries_.size(); ++j) {
+            const Entry& entry = *entries_[j];
+            if (rendered[j] || entry.name != first.name)
+                continue;
+            rendered[j] = true;
+
+            switch (entry.type) {
+                case Type::kCounter:
+                    snprintf(value, sizeof(value), "%llu",
+                             static_cast<unsigned long long>(
+                                 entry.counter->value()));
+                    AppendSample(&out, entry.name, entry.labels, nullptr, value);
+                    break;
+                case Type::kGauge:
+                    snprintf(value, sizeof(value), "%lld",
+                             static_cast<long long>(entry.gauge->value()));
+                    AppendSample(&out, entry.name, entry.labels, nullptr, value);
+                    break;
+                case Type::kHistogram: {
+                    const LatencyHistogram& histogram = *entry.histogram;
+                    uint64_t cumulative = 0;
+                    char le[32];
+                    for (size_t b = 0; b < LatencyHistogram::kBucketCount; ++b) {
+                        cumulative += histogram.bucket(b);
+                        snprintf(le, sizeof(le), "le=\"%g\"",
+                                 LatencyHistogram::kBucketBoundsUs[b] / 1e6);
+                        snprintf(value, sizeof(value), "%llu",
+                                 static_cast<unsigned long long>(cumulative));
+                        AppendSample(&out, entry.name + "_bucket",
+                                     entry.labels, le, value);
+                    }
+                    snprintf(value, sizeof(value), "%llu",
+                             static_cast<unsigned long long>(histogram.count()));
+                    AppendSample(&out, entry.name + "_bucket", entry.labels,
+                                 "le=\"+Inf\"", value);
+                    snprintf(value, sizeof(value), "%.9f",
+                             histogram.sum_ns() / 1e9);
+                    AppendSample(&out, entry.name + "_sum", entry.labels,
+                                 nullptr, value);
+                    snprintf(value, sizeof(value), "%llu",
+                             static_cast<unsigned long long>(histogram.count()));
+                    AppendSample(&out, entry.name + "_count", entry.labels,
+                                 nullptr, value);
+                    break;
+                }
+            }
+        }
+    }
+    return out;
+}
+
+MetricsServer::~MetricsServer() {
+    if (listen_fd_ >= 0) {
+        // Unblocks accept() in Run().
+        shutdown(listen_fd_, SHUT_RDWR);
+        if (thread_.joinable())
+            thread_.join();
+        close(listen_fd_);
+        unlink(socket_path_.c_str());
+    }
+}
+
+bool MetricsServer::Start(const std::string& socket_path) {
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+        return false;
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0)
+        return false;
+
+    unlink(socket_path.c_str());
+    if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&address),
+             sizeof(address)) != 0 ||
+        // adbd forwards scrapes as the shell user; the exposition holds
+        // nothing secret, and sepolicy limits who may connect.
+        chmod(socket_path.c_str(), 0666) != 0 ||
+        listen(listen_fd_, 4) != 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    socket_path_ = socket_path;
+
+    thread_ = std::thread(&MetricsServer::Run, this);
+    return true;
+}
+
+void MetricsServer::Run() {
+    while (true) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return;
+        }
+        struct timeval timeout = {kSendTimeoutSeconds, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        std::string exposition = MetricsRegistry::Get()->Render();
+        SendFully(fd, exposition.data(), exposition.size());
+        close(fd);
+    }
+}
+
+}  // namespace smartcard
@@ -0,0 +1,153 @@
+// Copyright 2016 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_COMMON_METRICS_H_
+#define SRC_COMMON_METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace smartcard {
+
+// Metric values are plain atomics: updating one never locks or allocates.
+class Counter final {
+ public:
+    void Increment(uint64_t n = 1) {
+        value_.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge final {
+ public:
+    void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Latency histogram with fixed buckets from 10us to 100ms.
+class LatencyHistogram final {
+ public:
+    static const size_t kBucketCount = 9;
+    static const int64_t kBucketBoundsUs[kBucketCount];
+
+    void Observe(int64_t latency_ns);
+
+    uint64_t bucket(size_t i) const {
+        return buckets_[i].load(std::memory_order_relaxed);
+    }
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum_ns() const { return sum_ns_.load(std::memory_order_relaxed); }
+
+ private:
+    std::atomic<uint64_t> buckets_[kBucketCount] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+};
+
+// Records the time from construction to destruction into a histogram.
+class ScopedLatency final {
+ public:
+    explicit ScopedLatency(LatencyHistogram* histogram);
+    ~ScopedLatency();
+
+ private:
+    LatencyHistogram* histogram_;
+    int64_t start_ns_;
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+};
+
+// Process-wide set of metrics. Metrics are registered once at start-up and
+// live as long as the process; the returned pointers are stable.
+class MetricsRegistry final {
+ public:
+    static MetricsRegistry* Get();
+
+    // |labels| is either empty or Prometheus label pairs, e.g.
+    // method="setWheelStatus". Metrics sharing a name form one family.
+    Counter* AddCounter(const std::string& name, const std::string& help,
+                        const std::string& labels = std::string{});
+    Gauge* AddGauge(const std::string& name, const std::string& help,
+                    const std::string& labels = std::string{});
+    LatencyHistogram* AddHistogram(const std::string& name,
+                                   const std::string& help,
+                                   const std::string& labels = std::string{});
+
+    // Prometheus text exposition of every metric plus the standard
+    // process CPU time and resident set size.
+    std::string Render() const;
+
+ private:
+    enum class Type { kCounter, kGauge, kHistogram };
+
+    struct Entry {
+        Type type;
+        std::string name;
+        std::string help;
+        std::string labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<LatencyHistogram> histogram;
+    };
+
+    MetricsRegistry() = default;
+
+    Entry* AddEntry(Type type, const std::string& name,
+                    const std::string& help, const std::string& labels);
+
+    mutable std::mutex mutex_;  // guards |entries_|, not the values
+    std::vector<std::unique_ptr<Entry>> entries_;
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+};
+
+// Serves MetricsRegistry::Render() on a Unix stream socket: every client
+// that connects gets one exposition and is disconnected. Runs on its own
+// thread so a wedged message loop still answers scrapes.
+class MetricsServer final {
+ public:
+    MetricsServer() = default;
+    ~MetricsServer();
+
+    bool Start(const std::string& socket_path);
+
+ private:
+    void Run();
+
+    std::string socket_path_;
+    int listen_fd_{-1};
+    std::thread thread_;
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+};
+
+}  // namespace smartcard
+
+#endif  // SRC_COMMON_METRICS_H_
@@ -0,0 +1,97 @@
+// Copyright 2016 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host-side scraper for the daemons' metrics sockets. Forward a socket
+// from the device, then print its Prometheus exposition:
+//
+//   adb forward tcp:9101 localfilesystem:/data/misc/smartcar/smartcard.metrics
+//   smartcar_metrics_scraper localhost:9101
+//
+// smartcar.te lets adbd and shell connect to the sockets, and the directory
+// is world-searchable so adbd, running as shell, can reach them. A path
+// containing '/' is read as a local Unix socket instead.
+
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace {
+
+int ConnectUnix(const char* path) {
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+                           sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int ConnectTcp(const std::string& endpoint) {
+    size_t colon = endpoint.rfind(':');
+    if (colon == std::string::npos)
+        return -1;
+    std::string host = endpoint.substr(0, colon);
+    std::string port = endpoint.substr(colon + 1);
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+        return -1;
+
+    int fd = -1;
+    for (struct addrinfo* a = addresses; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <host:port | socket path>\n", argv[0]);
+        return 1;
+    }
+
+    std::string endpoint = argv[1];
+    int fd = endpoint.find('/') != std::string::npos
+                 ? ConnectUnix(argv[1]) : ConnectTcp(endpoint);
+    if (fd < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    char buffer[4096];
+    ssize_t size;
+    while ((size = read(fd, buffer, sizeof(buffer))) > 0)
+        fwrite(buffer, 1, size, stdout);
+    close(fd);
+    return size < 0 ? 1 : 0;
+}
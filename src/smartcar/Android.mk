@@ -22,8 +22,14 @@ LOCAL_REQUIRED_MODULES := smartcar.json
 LOCAL_SRC_FILES := \
     action.cpp \
     action_forward.cpp \
+    action_pool.cpp \
+    capture_file.cpp \
+    command_dispatcher.cpp \
+    command_queue.cpp \
     configs.cpp \
+    replayer.cpp \
     smartcar.cpp \
+    tick_timer.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
     libbinder \
@@ -43,6 +49,34 @@ LOCAL_C_INCLUDES := thirdparty/paho.mqtt.c/src
 
 include $(BUILD_EXECUTABLE)
 
+# Unit tests
+# ========================================================
+include $(CLEAR_VARS)
+LOCAL_MODULE := smartcar_unittests
+
+LOCAL_SRC_FILES := \
+    action.cpp \
+    action_forward.cpp \
+    action_pool.cpp \
+    command_dispatcher.cpp \
+    command_dispatcher_unittest.cpp \
+    command_queue.cpp \
+    hot_path_unittest.cpp \
+    tick_timer.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+    libbinder \
+    libchrome \
+    libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+    libsmartcard \
+
+LOCAL_CFLAGS := -Wall -Werror
+LOCAL_CLANG := true
+
+include $(BUILD_NATIVE_TEST)
+
 # Weave schema files
 # ========================================================
 include $(CLEAR_VARS)
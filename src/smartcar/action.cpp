@@ -15,61 +15,148 @@
  */
 
 #include <base/bind.h>
-#include <base/message_loop/message_loop.h>
 
 #include "action.h"
-#include "action_forward.h"
+#include "binder_constants.h"
+#include "flight_recorder.h"
+#include "metrics.h"
 
+using smartcard::FlightEvent;
+using smartcard::FlightRecorder;
+using smartcard::MetricsRegistry;
 using yudatun::product::smartcar::ISmartCarService;
 
-Action::Action(
-    android::sp<ISmartCarService> smartcar_service,
-    const base::TimeDelta& duration)
-    : smartcar_service_{smartcar_service}, duration_{duration} {
+namespace {
+
+const size_t kWheelCount = 4;
+const uint8_t kAllWheelsMask = (1 << kWheelCount) - 1;
+
+const int* const kWheelPins[kWheelCount] = {
+    &smartcard::kLeftFrontWheelPin,
+    &smartcard::kRightFrontWheelPin,
+    &smartcard::kLeftAfterWheelPin,
+    &smartcard::kRightAfterWheelPin,
+};
+
+int GetWheelIndex(int pin) {
+    for (size_t i = 0; i < kWheelCount; ++i) {
+        if (*kWheelPins[i] == pin)
+            return i;
+    }
+    return -1;
+}
+
+// Shared by every action, registered on first use.
+struct TickMetrics {
+    smartcard::Counter* ticks{MetricsRegistry::Get()->AddCounter(
+        "smartcar_action_ticks_total", "Action ticks run.")};
+    smartcard::LatencyHistogram* latency{MetricsRegistry::Get()->AddHistogram(
+        "smartcar_action_tick_latency_seconds",
+        "Time spent in one action tick, binder calls included.")};
+};
+
+TickMetrics* GetTickMetrics() {
+    static TickMetrics* metrics = new TickMetrics;
+    return metrics;
+}
+
+bool RecordIfFailed(const android::binder::Status& status, int pin) {
+    if (!status.isOk()) {
+        FlightRecorder::Get()->Record(
+            FlightEvent::kBinderError, pin, status.exceptionCode());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+bool ParseActionType(base::StringPiece name, ActionType* type) {
+    if (name == "forward") {
+        *type = ActionType::kForward;
+        return true;
+    }
+    return false;
+}
+
+Action::Action()
+    : tick_timer_{base::Bind(&Action::OnTick, base::Unretained(this))} {
 }
 
 Action::~Action() {
-    SetAllWheels(false);
+    Finish();
+}
+
+void Action::Reset(
+    android::sp<ISmartCarService> smartcar_service,
+    const base::TimeDelta& duration,
+    int max_ticks) {
+    smartcar_service_ = smartcar_service;
+    duration_ = duration;
+    ticks_ = 0;
+    max_ticks_ = max_ticks;
+    wheel_mask_ = 0;
+    OnReset();
+}
+
+void Action::SetTickBoundaryCallback(const TickBoundaryCallback& callback) {
+    tick_boundary_callback_ = callback;
+}
+
+void Action::Finish() {
+    Stop();
+    // An action that never ticked has not touched the wheels.
+    if (smartcar_service_.get() && ticks_ > 0)
+        RecordIfFailed(smartcar_service_->setWheels(0), 0);
+    smartcar_service_ = nullptr;
+}
+
+void Action::HandOverTo(Action* next) {
+    Stop();
+    next->wheel_mask_ = wheel_mask_;
+    smartcar_service_ = nullptr;
 }
 
 void Action::Start() {
-    DoAction();
-    base::MessageLoop::current()->PostDelayedTask(
-        FROM_HERE,
-        base::Bind(&Action::Start, weak_ptr_factory_.GetWeakPtr()),
-        duration_);
+    Tick();
+    tick_timer_.Start(duration_);
 }
 
 void Action::Stop() {
-    weak_ptr_factory_.InvalidateWeakPtrs();
+    tick_timer_.Stop();
+}
+
+void Action::OnTick() {
+    if (!tick_boundary_callback_.is_null() &&
+        tick_boundary_callback_.Run(this)) {
+        return;
+    }
+    Tick();
+}
+
+void Action::Tick() {
+    FlightRecorder::Get()->Record(FlightEvent::kActionTick, 0, ++ticks_);
+    TickMetrics* metrics = GetTickMetrics();
+    metrics->ticks->Increment();
+    smartcard::ScopedLatency latency{metrics->latency};
+    DoAction();
+    RecordIfFailed(smartcar_service_->setWheels(wheel_mask_), 0);
 }
 
 bool Action::GetWheel(int pin) const {
     bool on = false;
-    smartcar_service_->getWheelStatus(pin, &on);
+    RecordIfFailed(smartcar_service_->getWheelStatus(pin, &on), pin);
     return on;
 }
 
 void Action::SetWheel(int pin, bool on) {
-    smartcar_service_->setWheelStatus(pin, on);
+    int index = GetWheelIndex(pin);
+    if (index < 0)
+        return;
+    uint8_t bit = 1 << index;
+    wheel_mask_ = on ? (wheel_mask_ | bit) : (wheel_mask_ & ~bit);
 }
 
 void Action::SetAllWheels(bool on) {
-    smartcar_service_->setAllWheels(on);
-}
-
-std::unique_ptr<Action> Action::Create(
-    android::sp<ISmartCarService> smartcar_service,
-    const std::string& type,
-    const base::TimeDelta& duration) {
-    std::unique_ptr<Action> action;
-
-    LOG(INFO) << "Action: {" << type << ", " << duration << "}";
-
-    if (type == "forward") {
-        action.reset(new ActionForward{smartcar_service, duration});
-    } else if (type == "back") {
-    }
-
-    return action;
+    wheel_mask_ = on ? kAllWheelsMask : 0;
 }
@@ -17,40 +17,89 @@
 #ifndef SRC_SMARTCAR_ACTION_H_
 #define SRC_SMARTCAR_ACTION_H_
 
+#include <stdint.h>
+
 #include <vector>
 #include <memory>
 
+#include <base/callback.h>
+#include <base/strings/string_piece.h>
 #include <base/time/time.h>
-#include <base/memory/weak_ptr.h>
 
+#include "tick_timer.h"
 #include "yudatun/product/smartcar/ISmartCarService.h"
 
+enum class ActionType {
+    kForward,
+    kCount,
+};
+
+// Maps a command's "type" onto an ActionType, false if unsupported.
+bool ParseActionType(base::StringPiece name, ActionType* type);
+
+// Actions are pooled and reused, see ActionPool.
 class Action {
  public:
-    Action(android::sp<yudatun::product::smartcar::ISmartCarService> smartcar_service,
-            const base::TimeDelta& duration);
+    // Runs at every tick boundary after the first. Returns true if the
+    // action was handed over or finished there and must not tick again.
+    using TickBoundaryCallback = base::Callback<bool(Action*)>;
+
+    Action();
     virtual ~Action();
 
+    // Prepares the action for another run of |max_ticks| ticks, one every
+    // |duration|. Zero ticks runs until the action is replaced.
+    void Reset(
+        android::sp<yudatun::product::smartcar::ISmartCarService> smartcar_service,
+        const base::TimeDelta& duration,
+        int max_ticks);
+
+    void SetTickBoundaryCallback(const TickBoundaryCallback& callback);
+
+    // Stops ticking and, if it ever ticked, switches every wheel off.
+    void Finish();
+
+    // Stops ticking and passes the desired wheel state on to |next|,
+    // leaving the wheels as they are.
+    void HandOverTo(Action* next);
+
+    // Ticks right away, then once every duration.
     void Start();
     void Stop();
 
-    static std::unique_ptr<Action> Create(
-        android::sp<yudatun::product::smartcar::ISmartCarService> smartcar_service,
-        const std::string& type,
-        const base::TimeDelta& duration);
+    bool unbounded() const { return max_ticks_ == 0; }
+    bool done() const { return max_ticks_ > 0 && ticks_ >= max_ticks_; }
+
+    virtual ActionType type() const = 0;
 
  protected:
+    virtual void OnReset() {}
     virtual void DoAction() = 0;
 
     bool GetWheel(int pin) const;
+    // Change the desired wheel state; it is sent after DoAction() returns.
     void SetWheel(int pin, bool on);
     void SetAllWheels(bool on);
 
  private:
+    void OnTick();
+    void Tick();
+
     android::sp<yudatun::product::smartcar::ISmartCarService> smartcar_service_;
     base::TimeDelta duration_;
+    int64_t ticks_{0};
+    int max_ticks_{0};
+
+    TickBoundaryCallback tick_boundary_callback_;
+
+    // Desired state of each wheel, one bit per kWheelPins entry. smartcard
+    // owns the actual state and only writes the wheels that differ, so
+    // the whole mask goes out every tick and a lease trip or another
+    // client's command cannot leave us out of step.
+    uint8_t wheel_mask_{0};
+
+    smartcar::TickTimer tick_timer_;
 
-    base::WeakPtrFactory<Action> weak_ptr_factory_{this};
     DISALLOW_COPY_AND_ASSIGN(Action);
 };
 
@@ -16,9 +16,8 @@
 
 #include "action_forward.h"
 
-ActionForward::ActionForward(
-    android::sp<yudatun::product::smartcar::ISmartCarService> smartcar_service,
-    const base::TimeDelta& duration) : Action{smartcar_service, duration} {
+void ActionForward::OnReset() {
+    on_ = true;
 }
 
 void ActionForward::DoAction() {
@@ -21,11 +21,12 @@
 
 class ActionForward : public Action {
  public:
-    ActionForward(
-        android::sp<yudatun::product::smartcar::ISmartCarService> smartcar_service,
-        const base::TimeDelta& duration);
+    ActionForward() = default;
+
+    ActionType type() const override { return ActionType::kForward; }
 
  protected:
+    void OnReset() override;
     void DoAction() override;
 
  private:
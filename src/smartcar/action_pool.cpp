@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#include <base/logging.h>
+
+#include "action_forward.h"
+#include "action_pool.h"
+
+using yudatun::product::smartcar::ISmartCarService;
+
+namespace smartcar {
+
+namespace {
+
+std::unique_ptr<Action> NewAction(ActionType type) {
+    switch (type) {
+        case ActionType::kForward:
+            return std::unique_ptr<Action>{new ActionForward};
+        case ActionType::kCount:
+            break;
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+void ActionPool::Releaser::operator()(Action* action) const {
+    if (pool_)
+        pool_->Release(action);
+}
+
+ActionPool::ActionPool() {
+    for (size_t t = 0; t < static_cast<size_t>(ActionType::kCount); ++t) {
+        free_[t].reserve(kActionsPerType);
+        for (size_t i = 0; i < kActionsPerType; ++i) {
+            actions_.push_back(NewAction(static_cast<ActionType>(t)));
+            free_[t].push_back(actions_.back().get());
+        }
+    }
+}
+
+ActionPool::ActionPtr ActionPool::Acquire(
+    android::sp<ISmartCarService> smartcar_service,
+    ActionType type,
+    const base::TimeDelta& duration,
+    int max_ticks) {
+    std::vector<Action*>& free = free_[static_cast<size_t>(type)];
+    if (free.empty()) {
+        LOG(WARNING) << "No free action of type " << static_cast<int>(type);
+        return ActionPtr{nullptr, Releaser{this}};
+    }
+    Action* action = free.back();
+    free.pop_back();
+    action->Reset(smartcar_service, duration, max_ticks);
+    return ActionPtr{action, Releaser{this}};
+}
+
+void ActionPool::Release(Action* action) {
+    action->Finish();
+    free_[static_cast<size_t>(action->type())].push_back(action);
+}
+
+}  // namespace smartcar
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#ifndef SRC_SMARTCAR_ACTION_POOL_H_
+#define SRC_SMARTCAR_ACTION_POOL_H_
+
+#include <memory>
+#include <vector>
+
+#include <base/macros.h>
+#include <base/time/time.h>
+
+#include "action.h"
+
+namespace smartcar {
+
+// Preallocates every Action up front so that handling a command never
+// goes to the heap. Handles give the action back to the pool, wheels off,
+// when they go out of scope.
+class ActionPool final {
+ public:
+    class Releaser {
+     public:
+        explicit Releaser(ActionPool* pool = nullptr) : pool_{pool} {}
+        void operator()(Action* action) const;
+
+     private:
+        ActionPool* pool_;
+    };
+    using ActionPtr = std::unique_ptr<Action, Releaser>;
+
+    // One running action plus the next one, prepared ahead of time.
+    static const size_t kActionsPerType = 2;
+
+    ActionPool();
+
+    // Returns an empty handle if all actions of |type| are in use.
+    ActionPtr Acquire(
+        android::sp<yudatun::product::smartcar::ISmartCarService> smartcar_service,
+        ActionType type,
+        const base::TimeDelta& duration,
+        int max_ticks);
+
+ private:
+    void Release(Action* action);
+
+    std::vector<std::unique_ptr<Action>> actions_;
+    std::vector<Action*> free_[static_cast<size_t>(ActionType::kCount)];
+
+    DISALLOW_COPY_AND_ASSIGN(ActionPool);
+};
+
+}  // namespace smartcar
+
+#endif  // SRC_SMARTCAR_ACTION_POOL_H_
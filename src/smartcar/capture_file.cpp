@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+
+#include "capture_file.h"
+
+namespace smartcar {
+
+namespace {
+
+const uint32_t kCaptureMagic = 0x50414353;  // "SCAP"
+// Version 1 stamped records with CLOCK_REALTIME only.
+const uint32_t kCaptureVersion = 2;
+
+// The file grows in steps of at least this much, so remapping is rare.
+const size_t kGrowBytes = 1 << 20;
+
+size_t Align8(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+uint64_t NowNanoseconds(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+}  // namespace
+
+CaptureWriter::~CaptureWriter() {
+    if (map_) {
+        // Trim the preallocated tail so the file holds only real records.
+        size_t data_end = header()->data_end;
+        munmap(map_, map_size_);
+        ignore_result(HANDLE_EINTR(ftruncate(fd_, data_end)));
+    }
+    if (fd_ >= 0)
+        IGNORE_EINTR(close(fd_));
+}
+
+bool CaptureWriter::Open(const base::FilePath& path) {
+    fd_ = HANDLE_EINTR(open(path.value().c_str(),
+                            O_RDWR | O_CREAT | O_CLOEXEC, 0640));
+    if (fd_ < 0) {
+        PLOG(ERROR) << "Failed to open capture file " << path.value();
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+        return false;
+
+    size_t file_size = st.st_size;
+    if (!Map(std::max(file_size, kGrowBytes)))
+        return false;
+
+    // Append to an existing capture, start a new one otherwise.
+    if (file_size < sizeof(CaptureHeader) ||
+        header()->magic != kCaptureMagic ||
+        header()->version != kCaptureVersion ||
+        header()->data_end > file_size) {
+        header()->magic = kCaptureMagic;
+        header()->version = kCaptureVersion;
+        header()->data_end = sizeof(CaptureHeader);
+    }
+    LOG(INFO) << "Capturing commands to " << path.value();
+    return true;
+}
+
+bool CaptureWriter::Append(const void* data, size_t size) {
+    if (!map_)
+        return false;
+
+    size_t data_end = header()->data_end;
+    size_t record_size = sizeof(CaptureRecordHeader) + Align8(size);
+    if (data_end + record_size > map_size_) {
+        size_t new_size = std::max(map_size_ * 2,
+                                   data_end + record_size + kGrowBytes);
+        if (!Map(new_size))
+            return false;
+    }
+
+    CaptureRecordHeader* record =
+        reinterpret_cast<CaptureRecordHeader*>(map_ + data_end);
+    record->timestamp_ns = NowNanoseconds(CLOCK_BOOTTIME);
+    record->wall_time_ns = NowNanoseconds(CLOCK_REALTIME);
+    record->size = size;
+    record->flags = new_session_ ? kCaptureRecordNewSession : 0;
+    new_session_ = false;
+    memcpy(record + 1, data, size);
+
+    // Publish the record only once it is completely written.
+    __atomic_store_n(&header()->data_end, data_end + record_size,
+                     __ATOMIC_RELEASE);
+    return true;
+}
+
+bool CaptureWriter::Map(size_t size) {
+    if (HANDLE_EINTR(ftruncate(fd_, size)) != 0) {
+        PLOG(ERROR) << "Failed to grow capture file";
+        return false;
+    }
+    if (map_)
+        munmap(map_, map_size_);
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        PLOG(ERROR) << "Failed to map capture file";
+        map_ = nullptr;
+        map_size_ = 0;
+        return false;
+    }
+    map_ = static_cast<char*>(map);
+    map_size_ = size;
+    return true;
+}
+
+CaptureReader::~CaptureReader() {
+    if (map_)
+        munmap(map_, map_size_);
+}
+
+bool CaptureReader::Open(const base::FilePath& path) {
+    int fd = HANDLE_EINTR(open(path.value().c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        PLOG(ERROR) << "Failed to open capture file " << path.value();
+        return false;
+    }
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 &&
+              static_cast<size_t>(st.st_size) >= sizeof(CaptureHeader);
+    if (ok) {
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            map_ = static_cast<char*>(map);
+            map_size_ = st.st_size;
+        }
+    }
+    IGNORE_EINTR(close(fd));
+    if (!map_) {
+        LOG(ERROR) << "Failed to map capture file " << path.value();
+        return false;
+    }
+
+    const CaptureHeader* header = reinterpret_cast<const CaptureHeader*>(map_);
+    if (header->magic != kCaptureMagic || header->version != kCaptureVersion) {
+        LOG(ERROR) << path.value() << " is not a capture file";
+        return false;
+    }
+    data_end_ = std::min<size_t>(header->data_end, map_size_);
+    position_ = sizeof(CaptureHeader);
+    return true;
+}
+
+bool CaptureReader::Next(CaptureRecord* record) {
+    if (position_ + sizeof(CaptureRecordHeader) > data_end_)
+        return false;
+
+    const CaptureRecordHeader* header =
+        reinterpret_cast<const CaptureRecordHeader*>(map_ + position_);
+    // Compare against what is left before doing any arithmetic on the
+    // size: on 32-bit targets a corrupt size would otherwise wrap around.
+    size_t available = data_end_ - position_ - sizeof(CaptureRecordHeader);
+    if (header->size > available)
+        return false;
+    size_t record_size = sizeof(CaptureRecordHeader) + Align8(header->size);
+    if (position_ + record_size > data_end_)
+        return false;
+
+    record->timestamp_ns = header->timestamp_ns;
+    record->wall_time_ns = header->wall_time_ns;
+    record->flags = header->flags;
+    record->data = reinterpret_cast<const char*>(header + 1);
+    record->size = header->size;
+    position_ += record_size;
+    return true;
+}
+
+}  // namespace smartcar
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#ifndef SRC_SMARTCAR_CAPTURE_FILE_H_
+#define SRC_SMARTCAR_CAPTURE_FILE_H_
+
+#include <stdint.h>
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+
+namespace smartcar {
+
+// On-disk layout: a CaptureHeader, then back to back records, each a
+// CaptureRecordHeader followed by the payload padded to 8 bytes. Only the
+// first |data_end| bytes are valid, so a capture cut short by a crash
+// still replays up to the last complete record.
+struct CaptureHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t data_end;
+};
+
+struct CaptureRecordHeader {
+    uint64_t timestamp_ns;  // CLOCK_BOOTTIME at arrival, used for pacing
+    uint64_t wall_time_ns;  // CLOCK_REALTIME at arrival, for humans only
+    uint32_t size;
+    uint32_t flags;
+};
+
+// Set on the first record written after CaptureWriter::Open(). Boot time
+// restarts on reboot, so gaps to such a record mean nothing.
+const uint32_t kCaptureRecordNewSession = 1 << 0;
+
+struct CaptureRecord {
+    uint64_t timestamp_ns;
+    uint64_t wall_time_ns;
+    uint32_t flags;
+    const char* data;
+    size_t size;
+};
+
+// Appends payloads to a memory-mapped capture file.
+class CaptureWriter final {
+ public:
+    CaptureWriter() = default;
+    ~CaptureWriter();
+
+    bool Open(const base::FilePath& path);
+    // Stamps the record with the current boot and wall clock time.
+    bool Append(const void* data, size_t size);
+
+ private:
+    bool Map(size_t size);
+    CaptureHeader* header() const {
+        return reinterpret_cast<CaptureHeader*>(map_);
+    }
+
+    int fd_{-1};
+    char* map_{nullptr};
+    size_t map_size_{0};
+    bool new_session_{true};
+
+    DISALLOW_COPY_AND_ASSIGN(CaptureWriter);
+};
+
+// Walks the records of a capture file in arrival order.
+class CaptureReader final {
+ public:
+    CaptureReader() = default;
+    ~CaptureReader();
+
+    bool Open(const base::FilePath& path);
+
+    // Returns false once every record has been read. |record| points into
+    // the mapping and stays valid for the lifetime of the reader.
+    bool Next(CaptureRecord* record);
+
+ private:
+    char* map_{nullptr};
+    size_t map_size_{0};
+    size_t data_end_{0};
+    size_t position_{0};
+
+    DISALLOW_COPY_AND_ASSIGN(CaptureReader);
+};
+
+}  // namespace smartcar
+
+#endif  // SRC_SMARTCAR_CAPTURE_FILE_H_
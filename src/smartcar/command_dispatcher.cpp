@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <limits>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/strings/string_piece.h>
+
+#include "command_dispatcher.h"
+
+using yudatun::product::smartcar::ISmartCarService;
+
+namespace smartcar {
+
+namespace {
+
+// Reads the flat JSON objects commands come as in place, without building
+// a value tree: only strings without escapes, numbers, true, false and
+// null are accepted as values.
+class CommandReader final {
+ public:
+    CommandReader(const char* data, size_t size)
+        : p_{data}, end_{data + size} {}
+
+    bool Read(base::StringPiece* type, double* duration, int* ticks) {
+        bool has_type = false;
+        bool has_duration = false;
+        if (!Consume('{'))
+            return false;
+        if (Consume('}'))
+            return has_type && has_duration;
+
+        do {
+            base::StringPiece key;
+            if (!ReadString(&key) || !Consume(':'))
+                return false;
+
+            SkipSpace();
+            if (key == "type") {
+                if (!ReadString(type))
+                    return false;
+                has_type = true;
+            } else if (key == "duration") {
+                if (!ReadNumber(duration))
+                    return false;
+                has_duration = true;
+            } else if (key == "ticks") {
+                double value = 0;
+                if (!ReadNumber(&value))
+                    return false;
+                // Like the old JSON reader, non-integers are ignored.
+                if (value >= std::numeric_limits<int>::min() &&
+                    value <= std::numeric_limits<int>::max() &&
+                    value == static_cast<int>(value))
+                    *ticks = static_cast<int>(value);
+            } else if (!SkipValue()) {
+                return false;
+            }
+        } while (Consume(','));
+
+        if (!Consume('}'))
+            return false;
+        SkipSpace();
+        return p_ == end_ && has_type && has_duration;
+    }
+
+ private:
+    void SkipSpace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' ||
+                             *p_ == '\n' || *p_ == '\r'))
+            ++p_;
+    }
+
+    bool Consume(char c) {
+        SkipSpace();
+        if (p_ == end_ || *p_ != c)
+            return false;
+        ++p_;
+        return true;
+    }
+
+    bool ReadString(base::StringPiece* value) {
+        if (!Consume('"'))
+            return false;
+        const char* start = p_;
+        while (p_ < end_ && *p_ != '"') {
+            if (*p_ == '\\')
+                return false;
+            ++p_;
+        }
+        if (p_ == end_)
+            return false;
+        *value = base::StringPiece{start, static_cast<size_t>(p_ - start)};
+        ++p_;
+        return true;
+    }
+
+    bool ReadNumber(double* value) {
+        // strtod wants a terminated string; numbers are short.
+        char buffer[32];
+        size_t size = 0;
+        while (p_ < end_ && size < sizeof(buffer) - 1 &&
+               strchr("+-.0123456789eE", *p_)) {
+            buffer[size++] = *p_++;
+        }
+        buffer[size] = '\0';
+        char* parsed_end = nullptr;
+        *value = strtod(buffer, &parsed_end);
+        return size > 0 && parsed_end == buffer + size;
+    }
+
+    bool SkipValue() {
+        if (p_ < end_ && *p_ == '"') {
+            base::StringPiece ignored;
+            return ReadString(&ignored);
+        }
+        for (const char* literal : {"true", "false", "null"}) {
+            size_t size = strlen(literal);
+            if (static_cast<size_t>(end_ - p_) >= size &&
+                memcmp(p_, literal, size) == 0) {
+                p_ += size;
+                return true;
+            }
+        }
+        double ignored = 0;
+        return ReadNumber(&ignored);
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+}  // namespace
+
+CommandDispatcher::CommandDispatcher()
+    : tick_boundary_callback_{base::Bind(&CommandDispatcher::OnTickBoundary,
+                                         base::Unretained(this))} {
+}
+
+void CommandDispatcher::SetSmartCarService(
+    android::sp<ISmartCarService> service) {
+    Reset();
+    smartcar_service_ = service;
+}
+
+bool CommandDispatcher::Dispatch(const char* payload, size_t size) {
+    if (!smartcar_service_.get())
+        return false;
+
+    base::StringPiece type;
+    double duration = 0;
+    PendingCommand command;
+    command.ticks = 0;
+    CommandReader reader{payload, size};
+    if (!reader.Read(&type, &duration, &command.ticks)) {
+        LOG(WARNING) << "Ignoring malformed command: "
+                     << base::StringPiece{payload, size};
+        return false;
+    }
+
+    if (!ParseActionType(type, &command.type))
+        return false;
+    command.duration = base::TimeDelta::FromSecondsD(duration);
+    VLOG(1) << "Action: {" << type << ", " << command.duration << ", "
+            << command.ticks << "}";
+
+    if (!action_) {
+        action_ = AcquireAction(command);
+        if (!action_)
+            return false;
+        action_->Start();
+        return true;
+    }
+
+    if (immediate_hand_over_) {
+        ActionPool::ActionPtr action = AcquireAction(command);
+        if (!action)
+            return false;
+        action_->HandOverTo(action.get());
+        action_ = std::move(action);
+        action_->Start();
+        return true;
+    }
+
+    if (!next_action_) {
+        next_action_ = AcquireAction(command);
+        return next_action_ != nullptr;
+    }
+
+    if (pending_count_ == kMaxPendingCommands) {
+        LOG(WARNING) << "Command queue full, dropping " << type;
+        return false;
+    }
+    pending_[(pending_head_ + pending_count_) % kMaxPendingCommands] = command;
+    ++pending_count_;
+    return true;
+}
+
+void CommandDispatcher::Reset() {
+    pending_count_ = 0;
+    next_action_.reset();
+    action_.reset();
+}
+
+ActionPool::ActionPtr CommandDispatcher::AcquireAction(
+    const PendingCommand& command) {
+    ActionPool::ActionPtr action = action_pool_.Acquire(
+        smartcar_service_, command.type, command.duration, command.ticks);
+    if (action)
+        action->SetTickBoundaryCallback(tick_boundary_callback_);
+    return action;
+}
+
+void CommandDispatcher::PrepareNext() {
+    if (next_action_ || pending_count_ == 0)
+        return;
+    next_action_ = AcquireAction(pending_[pending_head_]);
+    if (!next_action_) {
+        // Keep the command queued; the next tick boundary tries again.
+        LOG(WARNING) << "No action free for the next queued command, "
+                     << pending_count_ << " waiting";
+        return;
+    }
+    pending_head_ = (pending_head_ + 1) % kMaxPendingCommands;
+    --pending_count_;
+}
+
+bool CommandDispatcher::OnTickBoundary(Action* action) {
+    DCHECK_EQ(action, action_.get());
+    PrepareNext();
+
+    if (next_action_ && (action->unbounded() || action->done())) {
+        action->HandOverTo(next_action_.get());
+        // Returns |action| to the pool; the hand-over left the wheels alone.
+        action_ = std::move(next_action_);
+        PrepareNext();
+        action_->Start();
+        return true;
+    }
+
+    if (action->done()) {
+        action_.reset();
+        return true;
+    }
+    return false;
+}
+
+}  // namespace smartcar
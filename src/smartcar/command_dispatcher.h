@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#ifndef SRC_SMARTCAR_COMMAND_DISPATCHER_H_
+#define SRC_SMARTCAR_COMMAND_DISPATCHER_H_
+
+#include <stddef.h>
+
+#include <base/macros.h>
+#include <base/time/time.h>
+
+#include "action_pool.h"
+#include "yudatun/product/smartcar/ISmartCarService.h"
+
+namespace smartcar {
+
+// Parses command payloads, e.g. {"type": "forward", "duration": 1.5,
+// "ticks": 4}, and runs the matching Actions against the smart car
+// service. Live MQTT traffic and capture replay both go through here.
+//
+// Commands are queued. The head of the queue is acquired and reset ahead
+// of time, and swapped in at the running action's next tick boundary:
+// right away for an open-ended action, after its last tick for one with
+// "ticks". The wheels are handed over as they are, so a route of several
+// steps runs without stopping in between.
+class CommandDispatcher final {
+ public:
+    CommandDispatcher();
+
+    void SetSmartCarService(
+        android::sp<yudatun::product::smartcar::ISmartCarService> service);
+
+    // Queues the action described by |payload|.
+    bool Dispatch(const char* payload, size_t size);
+
+    // When set, every command replaces the running action right away
+    // instead of waiting for a tick boundary. Used to benchmark replay,
+    // where commands arrive back to back with no ticks in between.
+    void SetImmediateHandOver(bool immediate) {
+        immediate_hand_over_ = immediate;
+    }
+
+    // Stops the current action and drops everything queued.
+    void Reset();
+
+ private:
+    struct PendingCommand {
+        ActionType type;
+        base::TimeDelta duration;
+        int ticks;
+    };
+
+    static const size_t kMaxPendingCommands = 16;
+
+    ActionPool::ActionPtr AcquireAction(const PendingCommand& command);
+    void PrepareNext();
+    bool OnTickBoundary(Action* action);
+
+    android::sp<yudatun::product::smartcar::ISmartCarService> smartcar_service_;
+
+    // Declared before the actions, which are handed back on destruction.
+    ActionPool action_pool_;
+    ActionPool::ActionPtr action_;
+    ActionPool::ActionPtr next_action_;
+
+    // Commands behind |next_action_|, a ring of kMaxPendingCommands.
+    PendingCommand pending_[kMaxPendingCommands];
+    size_t pending_head_{0};
+    size_t pending_count_{0};
+
+    Action::TickBoundaryCallback tick_boundary_callback_;
+    bool immediate_hand_over_{false};
+
+    DISALLOW_COPY_AND_ASSIGN(CommandDispatcher);
+};
+
+}  // namespace smartcar
+
+#endif  // SRC_SMARTCAR_COMMAND_DISPATCHER_H_
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include <base/bind.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
+#include <gtest/gtest.h>
+
+#include "command_dispatcher.h"
+#include "fake_smartcar_service.h"
+
+namespace smartcar {
+
+namespace {
+
+const int32_t kAllOn = 0xf;
+
+// Forward pulses the wheels: on, off, on, ... one state per tick.
+const char kForwardThreeTicks[] =
+    "{\"type\": \"forward\", \"duration\": 0.01, \"ticks\": 3}";
+const char kForwardTwoTicks[] =
+    "{\"type\": \"forward\", \"duration\": 0.01, \"ticks\": 2}";
+const char kForwardOneTick[] =
+    "{\"type\": \"forward\", \"duration\": 0.01, \"ticks\": 1}";
+const char kForwardUnbounded[] =
+    "{\"type\": \"forward\", \"duration\": 0.05}";
+
+// Long enough for every command above to run to the end.
+const base::TimeDelta kRunTime = base::TimeDelta::FromMilliseconds(300);
+
+}  // namespace
+
+class CommandDispatcherTest : public ::testing::Test {
+ protected:
+    CommandDispatcherTest() : service_{new FakeSmartCarService} {
+        service_->RecordWheelMasks(&masks_);
+        dispatcher_.SetSmartCarService(service_);
+    }
+
+    ~CommandDispatcherTest() override {
+        dispatcher_.Reset();
+    }
+
+    void Dispatch(const char* command) {
+        EXPECT_TRUE(dispatcher_.Dispatch(command, strlen(command)))
+            << command;
+    }
+
+    void RunFor(base::TimeDelta duration) {
+        base::RunLoop run_loop;
+        loop_.task_runner()->PostDelayedTask(
+            FROM_HERE, run_loop.QuitClosure(), duration);
+        run_loop.Run();
+    }
+
+    base::MessageLoopForIO loop_;
+    android::sp<FakeSmartCarService> service_;
+    CommandDispatcher dispatcher_;
+    std::vector<int32_t> masks_;
+};
+
+TEST_F(CommandDispatcherTest, BoundedActionEndsWithWheelsOff) {
+    Dispatch(kForwardTwoTicks);
+    RunFor(kRunTime);
+    EXPECT_EQ((std::vector<int32_t>{kAllOn, 0, 0}), masks_);
+}
+
+TEST_F(CommandDispatcherTest, HandOverSendsNoIntermediateStop) {
+    Dispatch(kForwardThreeTicks);
+    Dispatch(kForwardTwoTicks);
+    RunFor(kRunTime);
+    // Three ticks, then two straight away with the wheels left on across
+    // the hand-over, then the final stop.
+    EXPECT_EQ((std::vector<int32_t>{kAllOn, 0, kAllOn, kAllOn, 0, 0}),
+              masks_);
+}
+
+TEST_F(CommandDispatcherTest, UnboundedActionIsReplacedAtNextTick) {
+    Dispatch(kForwardUnbounded);
+    Dispatch(kForwardOneTick);
+    RunFor(kRunTime);
+    // The open-ended action ticks once; at its next boundary the queued
+    // one takes over instead of a second tick.
+    EXPECT_EQ((std::vector<int32_t>{kAllOn, kAllOn, 0}), masks_);
+}
+
+TEST_F(CommandDispatcherTest, QueuedCommandsAllRun) {
+    for (int i = 0; i < 4; ++i)
+        Dispatch(kForwardOneTick);
+    RunFor(kRunTime);
+    EXPECT_EQ((std::vector<int32_t>{kAllOn, kAllOn, kAllOn, kAllOn, 0}),
+              masks_);
+}
+
+}  // namespace smartcar
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+
+#include "command_queue.h"
+
+namespace smartcar {
+
+const size_t CommandQueue::kSlotCount;
+const size_t CommandQueue::kMaxPayloadSize;
+
+// The free-running indices wrap at 2^32, which must stay a slot boundary.
+static_assert((CommandQueue::kSlotCount & (CommandQueue::kSlotCount - 1)) == 0,
+              "kSlotCount must be a power of two");
+
+CommandQueue::~CommandQueue() {
+    watcher_.StopWatchingFileDescriptor();
+    if (event_fd_ >= 0)
+        IGNORE_EINTR(close(event_fd_));
+}
+
+bool CommandQueue::Init(const Callback& callback) {
+    callback_ = callback;
+    event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (event_fd_ < 0) {
+        PLOG(ERROR) << "Failed to create command queue eventfd";
+        return false;
+    }
+    return base::MessageLoopForIO::current()->WatchFileDescriptor(
+        event_fd_, true, base::MessageLoopForIO::WATCH_READ, &watcher_, this);
+}
+
+bool CommandQueue::Push(const void* payload, size_t size) {
+    if (size > kMaxPayloadSize) {
+        LOG(WARNING) << "Dropping " << size << "-byte command, commands are "
+                     << "limited to " << kMaxPayloadSize << " bytes";
+        return false;
+    }
+
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == kSlotCount)
+        return false;
+
+    Slot& slot = slots_[tail % kSlotCount];
+    slot.size = size;
+    memcpy(slot.data, payload, size);
+    tail_.store(tail + 1, std::memory_order_release);
+
+    uint64_t one = 1;
+    ignore_result(HANDLE_EINTR(write(event_fd_, &one, sizeof(one))));
+    return true;
+}
+
+void CommandQueue::OnFileCanReadWithoutBlocking(int fd) {
+    uint64_t count = 0;
+    ignore_result(HANDLE_EINTR(read(fd, &count, sizeof(count))));
+
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    while (head != tail_.load(std::memory_order_acquire)) {
+        const Slot& slot = slots_[head % kSlotCount];
+        callback_.Run(slot.data, slot.size);
+        head_.store(++head, std::memory_order_release);
+    }
+}
+
+}  // namespace smartcar
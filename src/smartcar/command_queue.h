@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#ifndef SRC_SMARTCAR_COMMAND_QUEUE_H_
+#define SRC_SMARTCAR_COMMAND_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/message_loop/message_loop.h>
+
+namespace smartcar {
+
+// Hands command payloads from the MQTT client thread to the message loop
+// without allocating. Payloads are copied into a fixed ring of slots and
+// the loop is woken through an eventfd it watches, instead of a posted
+// task and a std::string per command.
+class CommandQueue final : public base::MessageLoopForIO::Watcher {
+ public:
+    using Callback = base::Callback<void(const char* payload, size_t size)>;
+
+    static const size_t kSlotCount = 16;
+    static const size_t kMaxPayloadSize = 256;
+
+    CommandQueue() = default;
+    ~CommandQueue() override;
+
+    // Runs |callback| on the current message loop for every payload.
+    bool Init(const Callback& callback);
+
+    // Copies |payload| in. Safe to call from one thread other than the
+    // loop's. Returns false if the payload is too big or the ring is full.
+    bool Push(const void* payload, size_t size);
+
+ private:
+    struct Slot {
+        uint32_t size;
+        char data[kMaxPayloadSize];
+    };
+
+    void OnFileCanReadWithoutBlocking(int fd) override;
+    void OnFileCanWriteWithoutBlocking(int fd) override {}
+
+    Slot slots_[kSlotCount];
+    // Free-running; slot index is the count modulo kSlotCount.
+    std::atomic<uint32_t> head_{0};  // next to read, loop thread only
+    std::atomic<uint32_t> tail_{0};  // next to write, producer only
+
+    int event_fd_{-1};
+    Callback callback_;
+    base::MessageLoopForIO::FileDescriptorWatcher watcher_;
+
+    DISALLOW_COPY_AND_ASSIGN(CommandQueue);
+};
+
+}  // namespace smartcar
+
+#endif  // SRC_SMARTCAR_COMMAND_QUEUE_H_
@@ -23,6 +23,14 @@ struct Configs final {
     std::string port_;
     int         qos_;
 
+    // smartcard lease renewed while connected, 0 disables the deadman.
+    int         lease_timeout_ms_;
+
+    // Command capture and replay, see capture_file.h.
+    std::string capture_path_;
+    std::string replay_path_;
+    double      replay_speed_;
+
     MQTTClient_connectOptions connect_options_;
 };
 
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#ifndef SRC_SMARTCAR_FAKE_SMARTCAR_SERVICE_H_
+#define SRC_SMARTCAR_FAKE_SMARTCAR_SERVICE_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <utils/String16.h>
+
+#include "binder_constants.h"
+#include "yudatun/product/smartcar/BnSmartCarService.h"
+
+namespace smartcar {
+
+// In-process stand-in for smartcard used by capture replay. Keeps the
+// wheel state in memory and counts the calls it receives.
+class FakeSmartCarService
+    : public yudatun::product::smartcar::BnSmartCarService {
+  public:
+    android::binder::Status getAllWheelNames(
+        std::vector<android::String16>* wheels) override {
+        ++call_count_;
+        *wheels = {android::String16{"left_front"},
+                   android::String16{"right_front"},
+                   android::String16{"left_after"},
+                   android::String16{"right_after"}};
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status getAllWheelPins(
+        std::vector<int>* wheels) override {
+        ++call_count_;
+        *wheels = pins_;
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status getAllWheelStatus(
+        std::vector<bool>* wheels) override {
+        ++call_count_;
+        *wheels = status_;
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status getWheelCount(int32_t* count) override {
+        ++call_count_;
+        *count = pins_.size();
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status setWheelStatus(int pin, bool on) override {
+        ++call_count_;
+        for (size_t i = 0; i < pins_.size(); ++i) {
+            if (pins_[i] == pin)
+                status_[i] = on;
+        }
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status getWheelStatus(int pin, bool *on) override {
+        ++call_count_;
+        *on = false;
+        for (size_t i = 0; i < pins_.size(); ++i) {
+            if (pins_[i] == pin)
+                *on = status_[i];
+        }
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status setAllWheels(bool on) override {
+        ++call_count_;
+        status_.assign(pins_.size(), on);
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status setWheels(int32_t on_mask) override {
+        ++call_count_;
+        if (wheel_masks_)
+            wheel_masks_->push_back(on_mask);
+        for (size_t i = 0; i < status_.size(); ++i)
+            status_[i] = (on_mask & (1 << i)) != 0;
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status setTwist(float, float) override {
+        ++call_count_;
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status renewLease(int) override {
+        ++call_count_;
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status getOdometry(
+        std::vector<int64_t>* ticks, std::vector<int32_t>* speeds,
+        int64_t* timestamp_ns) override {
+        ++call_count_;
+        ticks->assign(pins_.size(), 0);
+        speeds->assign(pins_.size(), 0);
+        *timestamp_ns = 0;
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status dumpFlightRecorder() override {
+        ++call_count_;
+        return android::binder::Status::ok();
+    }
+
+    uint64_t call_count() const { return call_count_; }
+
+    // Appends every setWheels() mask to |masks| from now on.
+    void RecordWheelMasks(std::vector<int32_t>* masks) {
+        wheel_masks_ = masks;
+    }
+
+  private:
+    std::vector<int> pins_{smartcard::kLeftFrontWheelPin,
+                           smartcard::kRightFrontWheelPin,
+                           smartcard::kLeftAfterWheelPin,
+                           smartcard::kRightAfterWheelPin};
+    std::vector<bool> status_ = std::vector<bool>(4, false);
+    uint64_t call_count_{0};
+    std::vector<int32_t>* wheel_masks_{nullptr};
+};
+
+}  // namespace smartcar
+
+#endif  // SRC_SMARTCAR_FAKE_SMARTCAR_SERVICE_H_
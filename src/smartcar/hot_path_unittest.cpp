@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+
+#include <base/bind.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
+#include <gtest/gtest.h>
+
+#include "command_dispatcher.h"
+#include "command_queue.h"
+#include "fake_smartcar_service.h"
+
+namespace {
+
+std::atomic<bool> g_counting{false};
+std::atomic<size_t> g_allocations{0};
+
+void* CountedAllocate(size_t size) {
+    if (g_counting.load(std::memory_order_relaxed))
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        abort();
+    return p;
+}
+
+void StartCounting(const base::Closure& steps) {
+    g_counting.store(true);
+    steps.Run();
+}
+
+void StopCounting(const base::Closure& quit) {
+    g_counting.store(false);
+    quit.Run();
+}
+
+const char kCommand[] = "{\"type\": \"forward\", \"duration\": 0.002, \"ticks\": 2}";
+const int kCommandCount = 4;
+
+}  // namespace
+
+// Every operator new in this binary is counted. Plain malloc() is not,
+// which leaves out C libraries but covers all the C++ on the path.
+void* operator new(size_t size) { return CountedAllocate(size); }
+void* operator new[](size_t size) { return CountedAllocate(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+
+namespace smartcar {
+
+class HotPathTest : public ::testing::Test {
+ protected:
+    HotPathTest() : service_{new FakeSmartCarService} {
+        dispatcher_.SetSmartCarService(service_);
+    }
+
+    ~HotPathTest() override {
+        dispatcher_.Reset();
+    }
+
+    // Runs |steps| from a task on the loop, then keeps the loop running
+    // for |duration|, and returns how many allocations happened meanwhile.
+    // Counting only starts once the loop is up, since starting a loop
+    // allocates.
+    size_t CountAllocations(const base::Closure& steps,
+                            base::TimeDelta duration) {
+        base::RunLoop run_loop;
+        // Posted first so that it already sits in the delayed work queue,
+        // which may grow, by the time counting starts.
+        loop_.task_runner()->PostDelayedTask(
+            FROM_HERE, base::Bind(&StopCounting, run_loop.QuitClosure()),
+            duration);
+        loop_.task_runner()->PostTask(
+            FROM_HERE, base::Bind(&StartCounting, steps));
+        g_allocations.store(0);
+        run_loop.Run();
+        return g_allocations.load();
+    }
+
+    void DispatchCommands() {
+        for (int i = 0; i < kCommandCount; ++i)
+            OnCommand(kCommand, sizeof(kCommand) - 1);
+    }
+
+    void PushCommands() {
+        for (int i = 0; i < kCommandCount; ++i)
+            queue_.Push(kCommand, sizeof(kCommand) - 1);
+    }
+
+    void OnCommand(const char* payload, size_t size) {
+        if (dispatcher_.Dispatch(payload, size))
+            ++accepted_;
+    }
+
+    base::MessageLoopForIO loop_;
+    android::sp<FakeSmartCarService> service_;
+    CommandDispatcher dispatcher_;
+    CommandQueue queue_;
+    int accepted_{0};
+};
+
+// Commands of two 2ms ticks each: parsing, queueing, hand-over at tick
+// boundaries, the ticks themselves and the service calls they make.
+TEST_F(HotPathTest, DispatchAndTicksDoNotAllocate) {
+    base::Closure steps =
+        base::Bind(&HotPathTest::DispatchCommands, base::Unretained(this));
+    base::TimeDelta duration = base::TimeDelta::FromMilliseconds(50);
+
+    // The first run creates the actions' timers and the metrics.
+    CountAllocations(steps, duration);
+    accepted_ = 0;
+    uint64_t calls = service_->call_count();
+
+    EXPECT_EQ(0u, CountAllocations(steps, duration));
+    EXPECT_EQ(kCommandCount, accepted_);
+    EXPECT_LT(calls, service_->call_count());
+}
+
+// The same, with the commands coming in through the MQTT-side queue.
+TEST_F(HotPathTest, QueuedCommandsDoNotAllocate) {
+    ASSERT_TRUE(queue_.Init(base::Bind(&HotPathTest::OnCommand,
+                                       base::Unretained(this))));
+    base::Closure steps =
+        base::Bind(&HotPathTest::PushCommands, base::Unretained(this));
+    base::TimeDelta duration = base::TimeDelta::FromMilliseconds(50);
+
+    CountAllocations(steps, duration);
+    accepted_ = 0;
+
+    EXPECT_EQ(0u, CountAllocations(steps, duration));
+    EXPECT_EQ(kCommandCount, accepted_);
+}
+
+}  // namespace smartcar
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#include <algorithm>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/message_loop/message_loop.h>
+
+#include "replayer.h"
+
+namespace smartcar {
+
+Replayer::Replayer(double speed, const base::Closure& done_callback)
+    : speed_{speed}, done_callback_{done_callback},
+      service_{new FakeSmartCarService} {
+    dispatcher_.SetSmartCarService(service_);
+}
+
+bool Replayer::Open(const base::FilePath& path) {
+    if (!reader_.Open(path))
+        return false;
+    has_next_ = reader_.Next(&next_record_);
+    return true;
+}
+
+void Replayer::Start() {
+    start_time_ = base::TimeTicks::Now();
+
+    if (speed_ <= 0) {
+        // Benchmark mode: no pacing, every command back to back.
+        dispatcher_.SetImmediateHandOver(true);
+        while (has_next_) {
+            Dispatch(next_record_);
+            has_next_ = reader_.Next(&next_record_);
+        }
+        Finish();
+        return;
+    }
+    DispatchNext();
+}
+
+void Replayer::DispatchNext() {
+    if (!has_next_) {
+        Finish();
+        return;
+    }
+
+    CaptureRecord record = next_record_;
+    Dispatch(record);
+
+    has_next_ = reader_.Next(&next_record_);
+    base::TimeDelta delay;
+    // Records from a later daemon run are replayed right away; their boot
+    // time stamps are unrelated to the previous record's.
+    if (has_next_ && !(next_record_.flags & kCaptureRecordNewSession) &&
+        next_record_.timestamp_ns > record.timestamp_ns) {
+        delay = base::TimeDelta::FromMicroseconds(
+            (next_record_.timestamp_ns - record.timestamp_ns) / 1000 / speed_);
+    }
+    base::MessageLoop::current()->PostDelayedTask(
+        FROM_HERE,
+        base::Bind(&Replayer::DispatchNext, weak_ptr_factory_.GetWeakPtr()),
+        delay);
+}
+
+void Replayer::Dispatch(const CaptureRecord& record) {
+    ++commands_;
+    bytes_ += record.size;
+    // Live commands pass through CommandQueue, which drops oversized ones;
+    // the capture still has them, so drop them here too.
+    if (record.size > CommandQueue::kMaxPayloadSize ||
+        !dispatcher_.Dispatch(record.data, record.size)) {
+        ++rejected_;
+    }
+}
+
+void Replayer::Finish() {
+    dispatcher_.Reset();
+
+    base::TimeDelta elapsed = base::TimeTicks::Now() - start_time_;
+    double seconds = std::max(elapsed.InSecondsF(), 1e-9);
+    uint64_t accepted = commands_ - rejected_;
+    LOG(INFO) << "Replayed " << commands_ << " commands (" << bytes_
+              << " bytes) in " << elapsed << ": " << accepted
+              << " accepted, " << rejected_ << " rejected, "
+              << accepted / seconds << " accepted commands/s, "
+              << service_->call_count() << " service calls";
+    done_callback_.Run();
+}
+
+}  // namespace smartcar
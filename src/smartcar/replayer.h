@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#ifndef SRC_SMARTCAR_REPLAYER_H_
+#define SRC_SMARTCAR_REPLAYER_H_
+
+#include <stdint.h>
+
+#include <base/callback.h>
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
+
+#include "capture_file.h"
+#include "command_dispatcher.h"
+#include "command_queue.h"
+#include "fake_smartcar_service.h"
+
+namespace smartcar {
+
+// Feeds a capture file back through a CommandDispatcher wired to a
+// FakeSmartCarService. |speed| scales the recorded gaps between commands;
+// zero or less replays as fast as possible and reports throughput. That
+// benchmark mode hands over to every command right away, since there are
+// no tick boundaries for the queue to drain at.
+class Replayer final {
+ public:
+    Replayer(double speed, const base::Closure& done_callback);
+
+    bool Open(const base::FilePath& path);
+    void Start();
+
+ private:
+    void DispatchNext();
+    void Dispatch(const CaptureRecord& record);
+    void Finish();
+
+    double speed_;
+    base::Closure done_callback_;
+
+    CaptureReader reader_;
+    CaptureRecord next_record_{};
+    bool has_next_{false};
+
+    android::sp<FakeSmartCarService> service_;
+    CommandDispatcher dispatcher_;
+
+    uint64_t commands_{0};
+    uint64_t rejected_{0};
+    uint64_t bytes_{0};
+    base::TimeTicks start_time_;
+
+    base::WeakPtrFactory<Replayer> weak_ptr_factory_{this};
+    DISALLOW_COPY_AND_ASSIGN(Replayer);
+};
+
+}  // namespace smartcar
+
+#endif  // SRC_SMARTCAR_REPLAYER_H_
@@ -8,17 +8,25 @@
 
 #include <sysexits.h>
 
+#include <algorithm>
+
 #include <base/bind.h>
 #include <base/command_line.h>
+#include <base/message_loop/message_loop.h>
 #include <binderwrapper/binder_wrapper.h>
 #include <brillo/binder_watcher.h>
 #include <brillo/daemons/daemon.h>
 #include <brillo/syslog_logging.h>
 
-#include "action.h"
 #include "binder_constants.h"
 #include "binder_utils.h"
+#include "capture_file.h"
+#include "command_dispatcher.h"
+#include "command_queue.h"
 #include "configs.h"
+#include "flight_recorder.h"
+#include "metrics.h"
+#include "replayer.h"
 #include "yudatun/product/smartcar/ISmartCarService.h"
 
 #include "MQTTClient.h"
@@ -28,6 +36,10 @@ using android::String16;
 using smartcard::binder_utils::ToString;
 using yudatun::product::smartcar::ISmartCarService;
 
+namespace {
+const char kMetricsSocketPath[] = "/data/misc/smartcar/smartcar.metrics";
+}
+
 class Daemon final : public brillo::Daemon {
  public:
     Daemon(smartcar::Configs configs)
@@ -40,10 +52,16 @@ class Daemon final : public brillo::Daemon {
     void MQTTSubscribe(void);
     int  OnMQTTServiceConnected(void *context, char *topicName, int topicLen, MQTTClient_message *message);
     void OnMQTTServiceLost(void *context, char *cause);
+    void OnCommandSourceLost();
+    void OnCommand(const char* payload, size_t size);
+
+    int StartReplay();
 
     void ConnectToSmartCarService();
     void OnSmartCarServiceDisconnected();
 
+    void RenewLease();
+
     void CreateSmartCarComponentsIfNeeded();
 
     void UpdateDeviceState();
@@ -55,14 +73,44 @@ class Daemon final : public brillo::Daemon {
 
     // Smart Car Service interface.
     android::sp<ISmartCarService> smartcar_service_;
+    base::TimeDelta connect_retry_delay_{base::TimeDelta::FromMilliseconds(10)};
+
+    // Turns command payloads into actions on |smartcar_service_|.
+    smartcar::CommandDispatcher dispatcher_;
+
+    // Carries payloads from the MQTT thread to OnCommand().
+    smartcar::CommandQueue command_queue_;
+
+    // Set when --capture is given; written from the MQTT thread.
+    std::unique_ptr<smartcar::CaptureWriter> capture_;
+
+    // Set when --replay is given, in which case nothing else runs.
+    std::unique_ptr<smartcar::Replayer> replayer_;
 
-    // Current action
-    std::unique_ptr<Action> action_;
+    scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
 
     brillo::BinderWatcher binder_watcher_;
 
+    // Owned by MetricsRegistry; bumped from the MQTT thread.
+    smartcard::Counter* commands_received_{
+        smartcard::MetricsRegistry::Get()->AddCounter(
+            "smartcar_commands_received_total",
+            "Command messages received from the MQTT broker.")};
+    smartcard::Counter* commands_rejected_{
+        smartcard::MetricsRegistry::Get()->AddCounter(
+            "smartcar_commands_rejected_total",
+            "Command messages that could not be parsed or queued.")};
+    smartcard::MetricsServer metrics_server_;
+
     bool smartcar_components_added_{false};
 
+    // Set when the MQTT connection drops, cleared by the next command.
+    // No lease is renewed in between.
+    bool command_source_lost_{false};
+
+    // Invalidated whenever the service goes away so that at most one lease
+    // renewal chain is ever pending.
+    base::WeakPtrFactory<Daemon> lease_weak_ptr_factory_{this};
     base::WeakPtrFactory<Daemon> weak_ptr_factory_{this};
     DISALLOW_COPY_AND_ASSIGN(Daemon);
 };
@@ -72,10 +120,29 @@ int Daemon::OnInit() {
     if (return_code != EX_OK)
         return return_code;
 
+    task_runner_ = base::MessageLoop::current()->task_runner();
+
+    if (!configs_.replay_path_.empty())
+        return StartReplay();
+
+    if (!configs_.capture_path_.empty()) {
+        capture_.reset(new smartcar::CaptureWriter);
+        if (!capture_->Open(base::FilePath{configs_.capture_path_}))
+            return EX_CANTCREAT;
+    }
+
     android::BinderWrapper::Create();
     if (!binder_watcher_.Init())
         return EX_OSERR;
 
+    if (!command_queue_.Init(base::Bind(&Daemon::OnCommand,
+                                        base::Unretained(this))))
+        return EX_OSERR;
+
+    // Metrics are nice to have, the car drives without them.
+    if (!metrics_server_.Start(kMetricsSocketPath))
+        PLOG(WARNING) << "Failed to serve metrics on " << kMetricsSocketPath;
+
     MQTTSubcribe();
 
     ConnectToSmartCarService();
@@ -91,14 +158,105 @@ void Daemon::MQTTSubscribe(void) {
 
 int Daemon::OnMQTTServiceConntected(
     void *context, char *topicName, int topicLen, MQTTClient_message *message) {
-    LOG(INFO) << "Message arrived";
+    smartcard::FlightRecorder::Get()->Record(
+        smartcard::FlightEvent::kCommandReceived, 0, message->payloadlen);
+    commands_received_->Increment();
+    VLOG(1) << "Message arrived";
+
+    if (capture_)
+        capture_->Append(message->payload, message->payloadlen);
 
+    // Paho calls us on its own thread; actions live on the message loop.
+    if (!command_queue_.Push(message->payload, message->payloadlen))
+        commands_rejected_->Increment();
     return 1;
 }
 
+void Daemon::OnCommand(const char* payload, size_t size) {
+    if (command_source_lost_) {
+        command_source_lost_ = false;
+        RenewLease();
+    }
+    if (!dispatcher_.Dispatch(payload, size))
+        commands_rejected_->Increment();
+}
+
+int Daemon::StartReplay() {
+    LOG(INFO) << "Replaying " << configs_.replay_path_ << " at "
+              << (configs_.replay_speed_ > 0 ? configs_.replay_speed_ : 0)
+              << "x (0 = maximum speed)";
+    replayer_.reset(new smartcar::Replayer{
+        configs_.replay_speed_,
+        base::Bind(&Daemon::Quit, weak_ptr_factory_.GetWeakPtr())});
+    if (!replayer_->Open(base::FilePath{configs_.replay_path_}))
+        return EX_NOINPUT;
+    task_runner_->PostTask(
+        FROM_HERE,
+        base::Bind(&smartcar::Replayer::Start,
+                   base::Unretained(replayer_.get())));
+    return EX_OK;
+}
+
 void Daemon::OnMQTTServiceLost(void *context, char *cause) {
     LOG(INFO) << "Connection lost";
     LOG(INFO) << "    cause: " << cause;
+
+    // Paho calls us on its own thread; actions live on the message loop.
+    task_runner_->PostTask(
+        FROM_HERE,
+        base::Bind(&Daemon::OnCommandSourceLost,
+                   weak_ptr_factory_.GetWeakPtr()));
+}
+
+void Daemon::OnCommandSourceLost() {
+    // Nobody is steering any more. Stop the running action and stop
+    // renewing, so that smartcard stops the wheels once the lease runs
+    // out even if the stop itself does not get through.
+    command_source_lost_ = true;
+    lease_weak_ptr_factory_.InvalidateWeakPtrs();
+    dispatcher_.Reset();
+}
+
+void Daemon::ConnectToSmartCarService() {
+    android::BinderWrapper* binder_wrapper = android::BinderWrapper::Get();
+    auto binder = binder_wrapper->GetService(smartcard::kBinderServiceName);
+    if (!binder.get()) {
+        // smartcard registers its service early, so retry quickly at first
+        // and back off only if it really is not coming up.
+        base::MessageLoop::current()->PostDelayedTask(
+            FROM_HERE,
+            base::Bind(&Daemon::ConnectToSmartCarService,
+                       weak_ptr_factory_.GetWeakPtr()),
+            connect_retry_delay_);
+        connect_retry_delay_ = std::min(connect_retry_delay_ * 2,
+                                        base::TimeDelta::FromSeconds(1));
+        return;
+    }
+    connect_retry_delay_ = base::TimeDelta::FromMilliseconds(10);
+    binder_wrapper->RegisterForDeathNotifications(
+        binder,
+        base::Bind(&Daemon::OnSmartCarServiceDisconnected,
+                   weak_ptr_factory_.GetWeakPtr()));
+    smartcar_service_ = android::interface_cast<ISmartCarService>(binder);
+    dispatcher_.SetSmartCarService(smartcar_service_);
+    LOG(INFO) << "Connected to smartcar service";
+
+    RenewLease();
+    CreateSmartCarComponentsIfNeeded();
+}
+
+void Daemon::RenewLease() {
+    if (!smartcar_service_.get() || configs_.lease_timeout_ms_ <= 0 ||
+        command_source_lost_)
+        return;
+
+    smartcar_service_->renewLease(configs_.lease_timeout_ms_);
+
+    // Renew well before expiry so one late wakeup does not stop the car.
+    base::MessageLoop::current()->PostDelayedTask(
+        FROM_HERE,
+        base::Bind(&Daemon::RenewLease, lease_weak_ptr_factory_.GetWeakPtr()),
+        base::TimeDelta::FromMilliseconds(configs_.lease_timeout_ms_ / 3));
 }
 
 void Daemon::CreateSmartCarComponentsIfNeeded() {
@@ -111,13 +269,15 @@ void Daemon::CreateSmartCarComponentsIfNeeded() {
 void Daemon::OnSmartCarServiceDisconnected() {
     LOG(INFO) << "Daemon::OnSmartCarServiceDisconnected";
 
-    action_.reset();
+    lease_weak_ptr_factory_.InvalidateWeakPtrs();
+    dispatcher_.SetSmartCarService(nullptr);
     smartcar_service_ = nullptr;
     ConnectToSmartCarService();
 }
 
 namespace {
 const char kDefaultConfigFilePath[] = "/etc/smartcar/config.json";
+const char kFlightRecorderPath[] = "/data/misc/smartcar/smartcar.flight";
 }
 
 int main(int argc, char *argv[]) {
@@ -130,9 +290,18 @@ int main(int argc, char *argv[]) {
     DEFINE_string(host, "localhost", "containing broker address");
     DEFINE_string(port, "1183", "containing broker port");
     DEFINE_int(qos, 0, "containing qos");
+    DEFINE_int32(lease_timeout_ms, 500,
+                 "smartcard stops all wheels if not renewed within this time");
+    DEFINE_string(capture, "",
+                  "Append every received command to this capture file");
+    DEFINE_string(replay, "",
+                  "Replay a capture file against a fake service, then exit");
+    DEFINE_double(replay_speed, 1.0,
+                  "Replay speed multiplier, 0 for as fast as possible");
 
     brillo::FlagHelper::Init(argc, argv, "MQTT protocol example daemon");
     brillo::InitLog(brillo::kLogToSyslog | brillo::kLogHeader);
+    smartcard::FlightRecorder::Get()->InstallSignalHandlers(kFlightRecorderPath);
 
     smartcar::Configs configs;
 
@@ -142,6 +311,12 @@ int main(int argc, char *argv[]) {
     configs.port_      = FLAGS_port;
     configs.qos_       = FLAGS_qos;
 
+    configs.lease_timeout_ms_ = FLAGS_lease_timeout_ms;
+
+    configs.capture_path_ = FLAGS_capture;
+    configs.replay_path_  = FLAGS_replay;
+    configs.replay_speed_ = FLAGS_replay_speed;
+
     configs.connect_options_ = MQTTClient_connectOptions_initializer;
 
     base::FilePath default_file_path{kDefaultConfigFilePath};
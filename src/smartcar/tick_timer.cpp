@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+
+#include "tick_timer.h"
+
+namespace smartcar {
+
+namespace {
+
+const int64_t kMinPeriodMicroseconds = 1000;
+
+}  // namespace
+
+TickTimer::TickTimer(const base::Closure& callback) : callback_{callback} {
+}
+
+TickTimer::~TickTimer() {
+    watcher_.StopWatchingFileDescriptor();
+    if (timer_fd_ >= 0)
+        IGNORE_EINTR(close(timer_fd_));
+}
+
+bool TickTimer::Start(base::TimeDelta period) {
+    if (timer_fd_ < 0) {
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (timer_fd_ < 0) {
+            PLOG(ERROR) << "timerfd_create failed";
+            return false;
+        }
+    }
+    // Watched for good: stopping the timer only disarms it, so restarting
+    // it never has to register with the loop again.
+    if (!watching_) {
+        watching_ = base::MessageLoopForIO::current()->WatchFileDescriptor(
+            timer_fd_, true, base::MessageLoopForIO::WATCH_READ,
+            &watcher_, this);
+        if (!watching_)
+            return false;
+    }
+
+    int64_t period_us = std::max(period.InMicroseconds(),
+                                 kMinPeriodMicroseconds);
+    struct itimerspec spec = {};
+    spec.it_interval.tv_sec = period_us / 1000000;
+    spec.it_interval.tv_nsec = (period_us % 1000000) * 1000;
+    spec.it_value = spec.it_interval;
+    return timerfd_settime(timer_fd_, 0, &spec, nullptr) == 0;
+}
+
+void TickTimer::Stop() {
+    // Disarming also clears expirations not read yet.
+    struct itimerspec spec = {};
+    if (timer_fd_ >= 0)
+        timerfd_settime(timer_fd_, 0, &spec, nullptr);
+}
+
+void TickTimer::OnFileCanReadWithoutBlocking(int fd) {
+    uint64_t expirations = 0;
+    if (HANDLE_EINTR(read(fd, &expirations, sizeof(expirations))) !=
+        sizeof(expirations)) {
+        // Stopped between the wakeup and now.
+        return;
+    }
+    callback_.Run();
+}
+
+}  // namespace smartcar
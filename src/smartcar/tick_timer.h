@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016 The Yudatun Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation
+ */
+
+#ifndef SRC_SMARTCAR_TICK_TIMER_H_
+#define SRC_SMARTCAR_TICK_TIMER_H_
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/message_loop/message_loop.h>
+#include <base/time/time.h>
+
+namespace smartcar {
+
+// Periodic timer on a timerfd watched by the current MessageLoopForIO.
+// PostDelayedTask allocates a task for every tick; this allocates once,
+// the first time it is started, and keeps a fixed cadence that does not
+// drift with the time spent in each tick. Ticks missed while the loop was
+// busy are folded into one.
+class TickTimer final : public base::MessageLoopForIO::Watcher {
+ public:
+    explicit TickTimer(const base::Closure& callback);
+    ~TickTimer() override;
+
+    // Runs the callback every |period|, the first time one period from
+    // now. Periods under a millisecond are rounded up.
+    bool Start(base::TimeDelta period);
+
+    // Safe to call from the callback.
+    void Stop();
+
+ private:
+    void OnFileCanReadWithoutBlocking(int fd) override;
+    void OnFileCanWriteWithoutBlocking(int fd) override {}
+
+    base::Closure callback_;
+    int timer_fd_{-1};
+    bool watching_{false};
+    base::MessageLoopForIO::FileDescriptorWatcher watcher_;
+
+    DISALLOW_COPY_AND_ASSIGN(TickTimer);
+};
+
+}  // namespace smartcar
+
+#endif  // SRC_SMARTCAR_TICK_TIMER_H_
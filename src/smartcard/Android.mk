@@ -19,6 +19,10 @@ LOCAL_MODULE := smartcard
 LOCAL_INIT_RC := smartcard.rc
 
 LOCAL_SRC_FILES := \
+    deadman.cpp \
+    edge_source.cpp \
+    encoder_monitor.cpp \
+    twist_mixer.cpp \
     wheels.cpp \
     smartcard.cpp \
 
@@ -39,3 +43,49 @@ LOCAL_CLANG := true
 LOCAL_CFLAGS := -Wall -Werror
 
 include $(BUILD_EXECUTABLE)
+
+# Unit tests
+# ========================================================
+include $(CLEAR_VARS)
+LOCAL_MODULE := smartcard_unittests
+
+LOCAL_SRC_FILES := \
+    deadman.cpp \
+    deadman_unittest.cpp \
+    edge_source.cpp \
+    encoder_monitor.cpp \
+    encoder_monitor_unittest.cpp \
+    twist_mixer.cpp \
+    twist_mixer_unittest.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+    libchrome \
+
+LOCAL_STATIC_LIBRARIES := \
+    libsmartcard \
+
+LOCAL_CLANG := true
+LOCAL_CFLAGS := -Wall -Werror
+
+include $(BUILD_NATIVE_TEST)
+
+# The encoder and mixer logic needs no GPIOs; run it on the host as well.
+include $(CLEAR_VARS)
+LOCAL_MODULE := smartcard_host_unittests
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../common
+
+LOCAL_SRC_FILES := \
+    ../common/binder_constants.cpp \
+    edge_source.cpp \
+    encoder_monitor.cpp \
+    encoder_monitor_unittest.cpp \
+    twist_mixer.cpp \
+    twist_mixer_unittest.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+    libchrome \
+
+LOCAL_CLANG := true
+LOCAL_CFLAGS := -Wall -Werror
+
+include $(BUILD_HOST_NATIVE_TEST)
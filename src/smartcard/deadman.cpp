@@ -0,0 +1,192 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <base/logging.h>
+#include <base/macros.h>
+#include <base/posix/eintr_wrapper.h>
+#include <base/strings/stringprintf.h>
+
+#include "deadman.h"
+#include "flight_recorder.h"
+#include "metrics.h"
+
+namespace smartcard {
+
+namespace {
+
+const char kGpioValuePathFormat[] = "/sys/class/gpio/gpio%d/value";
+
+const int64_t kNanosecondsPerSecond = 1000000000;
+
+int64_t NowNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * kNanosecondsPerSecond + ts.tv_nsec;
+}
+
+// Updated from the deadman thread itself, once per trip, so scrapes see
+// every expiry even if no binder call ever follows it.
+struct DeadmanMetrics {
+    Counter* trips{MetricsRegistry::Get()->AddCounter(
+        "smartcard_lease_trips_total",
+        "Times the deadman switch stopped the wheels.")};
+    Gauge* worst_stop_latency{MetricsRegistry::Get()->AddGauge(
+        "smartcard_worst_stop_latency_microseconds",
+        "Worst lease expiry to wheels-off latency seen so far.")};
+};
+
+DeadmanMetrics* GetDeadmanMetrics() {
+    static DeadmanMetrics* metrics = new DeadmanMetrics;
+    return metrics;
+}
+
+}  // namespace
+
+Deadman::Deadman(const std::vector<int>& pins) {
+    for (int pin : pins) {
+        value_files_.push_back(base::FilePath{
+            base::StringPrintf(kGpioValuePathFormat, pin)});
+    }
+}
+
+Deadman::Deadman(const std::vector<base::FilePath>& value_files)
+    : value_files_{value_files} {
+}
+
+Deadman::~Deadman() {
+    if (thread_.joinable()) {
+        quit_.store(true);
+        // Fire the timer right away so the thread notices |quit_|.
+        ArmTimer(1);
+        thread_.join();
+    }
+    if (timer_fd_ >= 0)
+        IGNORE_EINTR(close(timer_fd_));
+    for (int fd : value_fds_)
+        IGNORE_EINTR(close(fd));
+}
+
+bool Deadman::Start() {
+    // Register up front; the stop path must not take the registry lock.
+    GetDeadmanMetrics();
+
+    for (const base::FilePath& path : value_files_) {
+        int fd = HANDLE_EINTR(open(path.value().c_str(), O_WRONLY | O_CLOEXEC));
+        if (fd < 0) {
+            // A wheel the deadman cannot stop must not be driven at all.
+            PLOG(ERROR) << "Deadman: failed to open " << path.value();
+            for (int open_fd : value_fds_)
+                IGNORE_EINTR(close(open_fd));
+            value_fds_.clear();
+            return false;
+        }
+        value_fds_.push_back(fd);
+    }
+
+    if (timer_fd_ < 0)
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timer_fd_ < 0) {
+        PLOG(ERROR) << "Deadman: timerfd_create failed";
+        for (int fd : value_fds_)
+            IGNORE_EINTR(close(fd));
+        value_fds_.clear();
+        return false;
+    }
+    thread_ = std::thread(&Deadman::Run, this);
+
+    struct sched_param param = {};
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    int error = pthread_setschedparam(thread_.native_handle(), SCHED_FIFO, &param);
+    if (error != 0)
+        LOG(WARNING) << "Deadman: no real-time priority, error " << error;
+    return true;
+}
+
+void Deadman::Renew(base::TimeDelta timeout) {
+    int64_t deadline_ns = 0;
+    if (timeout > base::TimeDelta())
+        deadline_ns = NowNanoseconds() + timeout.InMicroseconds() * 1000;
+    deadline_ns_.store(deadline_ns, std::memory_order_release);
+    ArmTimer(deadline_ns);
+    // Only after the new deadline is published: an expiry of the old one
+    // racing with us then either fails its swap or is lifted here.
+    if (deadline_ns != 0)
+        stopped_.store(false);
+}
+
+bool Deadman::ConsumeTrip() {
+    return tripped_.exchange(false);
+}
+
+base::TimeDelta Deadman::GetWorstStopLatency() const {
+    return base::TimeDelta::FromMicroseconds(worst_latency_ns_.load() / 1000);
+}
+
+void Deadman::Run() {
+    while (!quit_.load()) {
+        uint64_t expirations = 0;
+        if (HANDLE_EINTR(read(timer_fd_, &expirations, sizeof(expirations))) < 0) {
+            PLOG(ERROR) << "Deadman: timerfd read failed";
+            return;
+        }
+
+        // A renewal may have raced with the expiry; only the thread that
+        // swaps the still-current deadline out gets to stop the wheels.
+        int64_t deadline_ns = deadline_ns_.load(std::memory_order_acquire);
+        if (deadline_ns == 0 || NowNanoseconds() < deadline_ns)
+            continue;
+        if (!deadline_ns_.compare_exchange_strong(deadline_ns, 0))
+            continue;
+
+        stopped_.store(true);
+        trip_count_.fetch_add(1);
+        StopAllWheels();
+        int64_t latency_ns = NowNanoseconds() - deadline_ns;
+        DeadmanMetrics* metrics = GetDeadmanMetrics();
+        metrics->trips->Increment();
+        if (latency_ns > worst_latency_ns_.load()) {
+            worst_latency_ns_.store(latency_ns);
+            metrics->worst_stop_latency->Set(latency_ns / 1000);
+        }
+        tripped_.store(true);
+        FlightRecorder::Get()->Record(FlightEvent::kLeaseExpired, 0, latency_ns);
+
+        LOG(WARNING) << "Deadman: lease expired, wheels stopped after "
+                     << latency_ns / 1000 << "us";
+    }
+}
+
+void Deadman::StopAllWheels() {
+    for (int fd : value_fds_)
+        ignore_result(HANDLE_EINTR(pwrite(fd, "0", 1, 0)));
+}
+
+void Deadman::ArmTimer(int64_t deadline_ns) {
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = deadline_ns / kNanosecondsPerSecond;
+    spec.it_value.tv_nsec = deadline_ns % kNanosecondsPerSecond;
+    if (timer_fd_ >= 0)
+        timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+}  // namespace smartcard
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_SMARTCARD_DEADMAN_H_
+#define SRC_SMARTCARD_DEADMAN_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/time/time.h>
+
+namespace smartcard {
+
+// Forces every wheel off when the client lease is not renewed in time.
+// The stop path runs on its own real-time thread, woken by a timerfd, and
+// writes to GPIO value files opened up front. It depends neither on the
+// binder thread pool nor on the daemon's message loop.
+class Deadman final {
+ public:
+    explicit Deadman(const std::vector<int>& pins);
+    // Writes "0" to |value_files| instead of the GPIO value files.
+    explicit Deadman(const std::vector<base::FilePath>& value_files);
+    ~Deadman();
+
+    // Must be called once the value files exist, i.e. the wheel GPIOs
+    // are exported. Fails unless every value file could be opened; it
+    // may then be called again.
+    bool Start();
+
+    // Arms the lease for another |timeout|. A zero timeout disarms it.
+    // Arming also lifts the stop left behind by an expired lease.
+    void Renew(base::TimeDelta timeout);
+
+    // True from an expiry until the lease is armed again. Wheels must not
+    // be switched on meanwhile.
+    bool IsStopped() const { return stopped_.load(); }
+
+    // Number of expiries so far. It is bumped before the wheels are
+    // written off, so a caller that wrote a wheel and then sees it change
+    // must assume its write landed after the stop and undo it.
+    uint64_t GetTripCount() const { return trip_count_.load(); }
+
+    // Returns true if the lease expired since the previous call. Several
+    // expiries fold into one; the trip counter metric counts each.
+    bool ConsumeTrip();
+
+    // Worst observed delay between lease expiry and all wheels written off.
+    base::TimeDelta GetWorstStopLatency() const;
+
+ private:
+    void Run();
+    void StopAllWheels();
+    void ArmTimer(int64_t deadline_ns);
+
+    std::vector<base::FilePath> value_files_;
+    std::vector<int> value_fds_;
+    int timer_fd_{-1};
+
+    // Absolute CLOCK_MONOTONIC deadline in nanoseconds, 0 when disarmed.
+    std::atomic<int64_t> deadline_ns_{0};
+    std::atomic<int64_t> worst_latency_ns_{0};
+    std::atomic<bool> tripped_{false};
+    std::atomic<bool> stopped_{false};
+    std::atomic<uint64_t> trip_count_{0};
+    std::atomic<bool> quit_{false};
+
+    std::thread thread_;
+
+    DISALLOW_COPY_AND_ASSIGN(Deadman);
+};
+
+}  // namespace smartcard
+
+#endif  // SRC_SMARTCARD_DEADMAN_H_
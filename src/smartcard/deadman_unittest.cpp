@@ -0,0 +1,173 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/strings/stringprintf.h>
+#include <gtest/gtest.h>
+
+#include "deadman.h"
+
+namespace smartcard {
+
+namespace {
+
+const size_t kWheelCount = 4;
+const int kTrips = 20;
+const base::TimeDelta kLeaseTimeout = base::TimeDelta::FromMilliseconds(10);
+const base::TimeDelta kTripTimeout = base::TimeDelta::FromSeconds(1);
+
+// The stop thread runs SCHED_FIFO, so a busy CPU should barely delay it.
+const base::TimeDelta kMaxStopLatency = base::TimeDelta::FromMilliseconds(10);
+
+// Keeps every CPU busy, plus one thread to spare, until destroyed.
+class CpuHogs final {
+ public:
+    CpuHogs() {
+        long count = sysconf(_SC_NPROCESSORS_ONLN) + 1;
+        for (long i = 0; i < count; ++i) {
+            threads_.emplace_back([this]() {
+                while (!stop_.load(std::memory_order_relaxed)) {
+                }
+            });
+        }
+    }
+
+    ~CpuHogs() {
+        stop_.store(true);
+        for (std::thread& thread : threads_)
+            thread.join();
+    }
+
+ private:
+    std::atomic<bool> stop_{false};
+    std::vector<std::thread> threads_;
+};
+
+bool WaitForTrip(Deadman* deadman) {
+    base::TimeTicks deadline = base::TimeTicks::Now() + kTripTimeout;
+    while (!deadman->ConsumeTrip()) {
+        if (base::TimeTicks::Now() > deadline)
+            return false;
+        usleep(1000);
+    }
+    return true;
+}
+
+}  // namespace
+
+TEST(DeadmanTest, StopsWheelsWithinBoundUnderCpuLoad) {
+    base::ScopedTempDir temp_dir;
+    ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+    std::vector<base::FilePath> value_files;
+    for (size_t i = 0; i < kWheelCount; ++i) {
+        value_files.push_back(temp_dir.path().Append(
+            base::StringPrintf("value%zu", i)));
+        ASSERT_EQ(1, base::WriteFile(value_files.back(), "1", 1));
+    }
+
+    Deadman deadman{value_files};
+    ASSERT_TRUE(deadman.Start());
+
+    CpuHogs hogs;
+    for (int trip = 0; trip < kTrips; ++trip) {
+        for (const base::FilePath& file : value_files)
+            ASSERT_EQ(1, base::WriteFile(file, "1", 1));
+
+        deadman.Renew(kLeaseTimeout);
+        ASSERT_TRUE(WaitForTrip(&deadman)) << "trip " << trip;
+
+        for (const base::FilePath& file : value_files) {
+            std::string value;
+            ASSERT_TRUE(base::ReadFileToString(file, &value));
+            EXPECT_EQ("0", value) << file.value();
+        }
+    }
+
+    base::TimeDelta worst = deadman.GetWorstStopLatency();
+    RecordProperty("worst_stop_latency_us",
+                   static_cast<int>(worst.InMicroseconds()));
+    EXPECT_LT(worst, kMaxStopLatency);
+}
+
+TEST(DeadmanTest, RenewalKeepsWheelsRunning) {
+    base::ScopedTempDir temp_dir;
+    ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+    base::FilePath value_file = temp_dir.path().Append("value");
+    ASSERT_EQ(1, base::WriteFile(value_file, "1", 1));
+
+    Deadman deadman{std::vector<base::FilePath>{value_file}};
+    ASSERT_TRUE(deadman.Start());
+
+    for (int i = 0; i < 10; ++i) {
+        deadman.Renew(base::TimeDelta::FromMilliseconds(50));
+        usleep(10000);
+    }
+    EXPECT_FALSE(deadman.ConsumeTrip());
+
+    // A zero timeout disarms the lease altogether.
+    deadman.Renew(base::TimeDelta());
+    usleep(100000);
+    EXPECT_FALSE(deadman.ConsumeTrip());
+
+    std::string value;
+    ASSERT_TRUE(base::ReadFileToString(value_file, &value));
+    EXPECT_EQ("1", value);
+}
+
+TEST(DeadmanTest, StaysStoppedUntilTheLeaseIsArmedAgain) {
+    base::ScopedTempDir temp_dir;
+    ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+    base::FilePath value_file = temp_dir.path().Append("value");
+    ASSERT_EQ(1, base::WriteFile(value_file, "1", 1));
+
+    Deadman deadman{std::vector<base::FilePath>{value_file}};
+    ASSERT_TRUE(deadman.Start());
+    EXPECT_FALSE(deadman.IsStopped());
+    EXPECT_EQ(0u, deadman.GetTripCount());
+
+    deadman.Renew(kLeaseTimeout);
+    ASSERT_TRUE(WaitForTrip(&deadman));
+    EXPECT_TRUE(deadman.IsStopped());
+    EXPECT_EQ(1u, deadman.GetTripCount());
+
+    // Releasing the lease does not lift the stop, arming it does.
+    deadman.Renew(base::TimeDelta());
+    EXPECT_TRUE(deadman.IsStopped());
+    deadman.Renew(kTripTimeout);
+    EXPECT_FALSE(deadman.IsStopped());
+    deadman.Renew(base::TimeDelta());
+}
+
+TEST(DeadmanTest, FailsToStartIfAnyValueFileIsMissing) {
+    base::ScopedTempDir temp_dir;
+    ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+    base::FilePath present = temp_dir.path().Append("value0");
+    ASSERT_EQ(1, base::WriteFile(present, "1", 1));
+
+    Deadman deadman{std::vector<base::FilePath>{
+        present, temp_dir.path().Append("value1")}};
+    EXPECT_FALSE(deadman.Start());
+}
+
+}  // namespace smartcard
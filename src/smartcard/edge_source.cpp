@@ -0,0 +1,195 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <base/logging.h>
+#include <base/macros.h>
+#include <base/posix/eintr_wrapper.h>
+
+#include "edge_source.h"
+
+namespace smartcard {
+
+namespace {
+
+const char kConsumerLabel[] = "smartcard-encoder";
+
+// epoll user data of the interrupt eventfd; channels use their index.
+const uint32_t kInterruptToken = UINT32_MAX;
+
+const int kMaxEvents = 16;
+
+// As deep as the kernel's per-line event queue, so one read drains it.
+const int kMaxEdgesPerRead = 16;
+
+int64_t NowNanoseconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Maps a line event timestamp onto CLOCK_MONOTONIC. A monotonic stamp can
+// never be ahead of the monotonic clock read after it; anything that is
+// must be a wall clock stamp from a pre-5.7 kernel.
+int64_t ToMonotonic(uint64_t timestamp, int64_t monotonic_now,
+                    int64_t realtime_now) {
+    int64_t stamp = static_cast<int64_t>(timestamp);
+    if (stamp <= monotonic_now)
+        return stamp;
+    return monotonic_now - (realtime_now - stamp);
+}
+
+}  // namespace
+
+GpioLineEdgeSource::~GpioLineEdgeSource() {
+    for (int fd : event_fds_)
+        IGNORE_EINTR(close(fd));
+    if (epoll_fd_ >= 0)
+        IGNORE_EINTR(close(epoll_fd_));
+    if (interrupt_fd_ >= 0)
+        IGNORE_EINTR(close(interrupt_fd_));
+}
+
+bool GpioLineEdgeSource::Open(const char* chip_path,
+                              const std::vector<int>& offsets) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    interrupt_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epoll_fd_ < 0 || interrupt_fd_ < 0) {
+        PLOG(ERROR) << "Failed to set up edge polling";
+        return false;
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = kInterruptToken;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, interrupt_fd_, &event);
+
+    int chip_fd = HANDLE_EINTR(open(chip_path, O_RDONLY | O_CLOEXEC));
+    if (chip_fd < 0) {
+        PLOG(ERROR) << "Failed to open " << chip_path;
+        return false;
+    }
+
+    // The line fds outlive the chip fd they were requested through.
+    bool ok = true;
+    for (int offset : offsets) {
+        struct gpioevent_request request = {};
+        request.lineoffset = offset;
+        request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+        request.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+        strncpy(request.consumer_label, kConsumerLabel,
+                sizeof(request.consumer_label) - 1);
+        if (ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request) != 0) {
+            PLOG(ERROR) << "Failed to request edge events on line " << offset;
+            ok = false;
+            break;
+        }
+        int fd = request.fd;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        event.events = EPOLLIN;
+        event.data.u32 = event_fds_.size();
+        event_fds_.push_back(fd);
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            PLOG(ERROR) << "Failed to poll line " << offset;
+            ok = false;
+            break;
+        }
+    }
+    IGNORE_EINTR(close(chip_fd));
+    return ok;
+}
+
+bool GpioLineEdgeSource::Wait(uint32_t* counts, int64_t* last_edge_ns) {
+    struct epoll_event events[kMaxEvents];
+    int count = HANDLE_EINTR(epoll_wait(epoll_fd_, events, kMaxEvents, -1));
+    if (count < 0) {
+        PLOG(ERROR) << "epoll_wait failed";
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        uint32_t channel = events[i].data.u32;
+        if (channel == kInterruptToken)
+            return false;
+
+        // One event per edge: count every one read until the queue is dry.
+        struct gpioevent_data edges[kMaxEdgesPerRead];
+        while (true) {
+            ssize_t size = HANDLE_EINTR(
+                read(event_fds_[channel], edges, sizeof(edges)));
+            if (size < static_cast<ssize_t>(sizeof(edges[0])))
+                break;
+            // After the read, so every stamp read is older than these.
+            int64_t monotonic_now = NowNanoseconds(CLOCK_MONOTONIC);
+            int64_t realtime_now = NowNanoseconds(CLOCK_REALTIME);
+            size_t edge_count = size / sizeof(edges[0]);
+            counts[channel] += edge_count;
+            last_edge_ns[channel] = ToMonotonic(
+                edges[edge_count - 1].timestamp, monotonic_now, realtime_now);
+        }
+    }
+    return true;
+}
+
+void GpioLineEdgeSource::Interrupt() {
+    uint64_t one = 1;
+    ignore_result(HANDLE_EINTR(write(interrupt_fd_, &one, sizeof(one))));
+}
+
+FakeEdgeSource::FakeEdgeSource(size_t channel_count)
+    : pending_(channel_count, 0), pending_last_edge_ns_(channel_count, 0) {
+}
+
+void FakeEdgeSource::Inject(size_t channel, uint32_t edges,
+                            int64_t timestamp_ns) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    pending_[channel] += edges;
+    pending_last_edge_ns_[channel] = timestamp_ns;
+    has_pending_ = true;
+    cond_.notify_one();
+}
+
+bool FakeEdgeSource::Wait(uint32_t* counts, int64_t* last_edge_ns) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    cond_.wait(lock, [this]() { return has_pending_ || interrupted_; });
+    if (interrupted_)
+        return false;
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        if (pending_[i] == 0)
+            continue;
+        counts[i] += pending_[i];
+        last_edge_ns[i] = pending_last_edge_ns_[i];
+        pending_[i] = 0;
+    }
+    has_pending_ = false;
+    return true;
+}
+
+void FakeEdgeSource::Interrupt() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    interrupted_ = true;
+    cond_.notify_one();
+}
+
+}  // namespace smartcard
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_SMARTCARD_EDGE_SOURCE_H_
+#define SRC_SMARTCARD_EDGE_SOURCE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <base/macros.h>
+
+namespace smartcard {
+
+// Where EncoderMonitor gets its edges from, one channel per encoder.
+class EdgeSource {
+ public:
+    virtual ~EdgeSource() = default;
+
+    virtual size_t GetChannelCount() const = 0;
+
+    // Blocks until at least one edge arrives. For every channel i that saw
+    // edges, adds their number to |counts[i]| and stores the timestamp of
+    // the newest one in |last_edge_ns[i]|. Timestamps are in nanoseconds
+    // on the source's own clock and only meaningful relative to each
+    // other. Returns false once Interrupt() has been called.
+    virtual bool Wait(uint32_t* counts, int64_t* last_edge_ns) = 0;
+
+    // Wakes up Wait() for good. May be called from any thread.
+    virtual void Interrupt() = 0;
+};
+
+// Rising edges of GPIO lines requested through the GPIO character device
+// (GPIO_GET_LINEEVENT_IOCTL, Linux 4.8 and later). The kernel queues every
+// edge with its own timestamp, so edges that arrive between two wakeups
+// are counted rather than merged. The per-line queue holds 16 events; the
+// reader has to drain it at least that often to keep up.
+//
+// Edge timestamps are CLOCK_REALTIME before Linux 5.7 and CLOCK_MONOTONIC
+// since. Wait() reports them on CLOCK_MONOTONIC either way, converting at
+// read time, so a wall clock step between batches does not skew speeds.
+class GpioLineEdgeSource final : public EdgeSource {
+ public:
+    GpioLineEdgeSource() = default;
+    ~GpioLineEdgeSource() override;
+
+    // Requests |offsets| as inputs on the GPIO chip at |chip_path|. The
+    // lines must not be exported through sysfs at the same time.
+    bool Open(const char* chip_path, const std::vector<int>& offsets);
+
+    size_t GetChannelCount() const override { return event_fds_.size(); }
+    bool Wait(uint32_t* counts, int64_t* last_edge_ns) override;
+    void Interrupt() override;
+
+ private:
+    std::vector<int> event_fds_;
+    int epoll_fd_{-1};
+    int interrupt_fd_{-1};
+
+    DISALLOW_COPY_AND_ASSIGN(GpioLineEdgeSource);
+};
+
+// Edges injected by hand, to drive EncoderMonitor on a host without GPIOs.
+class FakeEdgeSource final : public EdgeSource {
+ public:
+    explicit FakeEdgeSource(size_t channel_count);
+
+    // Adds |edges| edges on |channel|, the newest one at |timestamp_ns|.
+    void Inject(size_t channel, uint32_t edges, int64_t timestamp_ns);
+
+    size_t GetChannelCount() const override { return pending_.size(); }
+    bool Wait(uint32_t* counts, int64_t* last_edge_ns) override;
+    void Interrupt() override;
+
+ private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<uint32_t> pending_;
+    std::vector<int64_t> pending_last_edge_ns_;
+    bool has_pending_{false};
+    bool interrupted_{false};
+
+    DISALLOW_COPY_AND_ASSIGN(FakeEdgeSource);
+};
+
+}  // namespace smartcard
+
+#endif  // SRC_SMARTCARD_EDGE_SOURCE_H_
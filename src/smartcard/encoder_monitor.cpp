@@ -0,0 +1,129 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <base/logging.h>
+
+#include "encoder_monitor.h"
+
+namespace smartcard {
+
+namespace {
+
+// 1000 milli-ticks per tick times 1e9 ns per second.
+const int64_t kMilliTickNanoseconds = 1000000000000LL;
+
+int64_t NowNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+}  // namespace
+
+const size_t EncoderMonitor::kMaxChannels;
+
+EncoderMonitor::EncoderMonitor(std::unique_ptr<EdgeSource> source)
+    : source_{std::move(source)},
+      channel_count_{std::min(source_->GetChannelCount(), kMaxChannels)} {
+}
+
+EncoderMonitor::~EncoderMonitor() {
+    if (thread_.joinable()) {
+        source_->Interrupt();
+        thread_.join();
+    }
+}
+
+bool EncoderMonitor::Start() {
+    // Run() hands the source per-channel arrays of kMaxChannels entries.
+    if (source_->GetChannelCount() > kMaxChannels) {
+        LOG(ERROR) << "EncoderMonitor: " << source_->GetChannelCount()
+                   << " channels, at most " << kMaxChannels << " supported";
+        return false;
+    }
+    thread_ = std::thread(&EncoderMonitor::Run, this);
+
+    // Just below the deadman, so a burst of edges cannot delay a stop.
+    struct sched_param param = {};
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+    int error = pthread_setschedparam(thread_.native_handle(), SCHED_FIFO, &param);
+    if (error != 0)
+        LOG(WARNING) << "EncoderMonitor: no real-time priority, error " << error;
+    return true;
+}
+
+int64_t EncoderMonitor::GetSnapshot(std::vector<int64_t>* ticks,
+                                    std::vector<int32_t>* speeds) const {
+    int64_t now = NowNanoseconds();
+    ticks->resize(channel_count_);
+    speeds->resize(channel_count_);
+    for (size_t i = 0; i < channel_count_; ++i) {
+        const Channel& channel = channels_[i];
+        (*ticks)[i] = channel.ticks.load(std::memory_order_relaxed);
+
+        // Once edges stop, let the estimate decay with the time since the
+        // last one instead of reporting the last speed forever.
+        int64_t period = channel.period_ns.load(std::memory_order_relaxed);
+        int64_t since_last =
+            now - channel.last_seen_ns.load(std::memory_order_relaxed);
+        int64_t effective = std::max(period, since_last);
+        int64_t speed = period > 0 && effective > 0
+                            ? kMilliTickNanoseconds / effective : 0;
+        (*speeds)[i] = std::min<int64_t>(
+            speed, std::numeric_limits<int32_t>::max());
+    }
+    return now;
+}
+
+void EncoderMonitor::Run() {
+    uint32_t counts[kMaxChannels] = {};
+    int64_t last_edge_ns[kMaxChannels] = {};
+    // Newest edge timestamp of the previous batch, per channel.
+    int64_t previous_edge_ns[kMaxChannels] = {};
+    while (source_->Wait(counts, last_edge_ns)) {
+        int64_t now = NowNanoseconds();
+        for (size_t i = 0; i < channel_count_; ++i) {
+            if (counts[i] == 0)
+                continue;
+            Channel& channel = channels_[i];
+            channel.ticks.fetch_add(counts[i], std::memory_order_relaxed);
+
+            // The edges of this batch span the time since the newest edge
+            // of the previous one, however late the thread woke up.
+            if (previous_edge_ns[i] > 0 &&
+                last_edge_ns[i] > previous_edge_ns[i]) {
+                int64_t interval =
+                    (last_edge_ns[i] - previous_edge_ns[i]) / counts[i];
+                int64_t period =
+                    channel.period_ns.load(std::memory_order_relaxed);
+                period = period > 0 ? (period * 3 + interval) / 4 : interval;
+                channel.period_ns.store(period, std::memory_order_relaxed);
+            }
+            previous_edge_ns[i] = last_edge_ns[i];
+            channel.last_seen_ns.store(now, std::memory_order_relaxed);
+            counts[i] = 0;
+        }
+    }
+}
+
+}  // namespace smartcard
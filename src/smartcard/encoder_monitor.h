@@ -0,0 +1,75 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_SMARTCARD_ENCODER_MONITOR_H_
+#define SRC_SMARTCARD_ENCODER_MONITOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <base/macros.h>
+
+#include "edge_source.h"
+
+namespace smartcard {
+
+// Counts wheel encoder ticks on a dedicated thread that sleeps on the
+// EdgeSource, and keeps a per-wheel speed estimate. Readers take
+// snapshots from any thread without locking.
+class EncoderMonitor final {
+ public:
+    static const size_t kMaxChannels = 8;
+
+    explicit EncoderMonitor(std::unique_ptr<EdgeSource> source);
+    ~EncoderMonitor();
+
+    // Fails if the source has more than kMaxChannels channels.
+    bool Start();
+
+    // Fills one entry per encoder and returns the CLOCK_MONOTONIC time of
+    // the snapshot in nanoseconds. Speeds are in milli-ticks per second.
+    int64_t GetSnapshot(std::vector<int64_t>* ticks,
+                        std::vector<int32_t>* speeds) const;
+
+ private:
+    struct Channel {
+        std::atomic<int64_t> ticks{0};
+        // CLOCK_MONOTONIC time the newest edge was picked up.
+        std::atomic<int64_t> last_seen_ns{0};
+        // Smoothed time between edges, from the edge timestamps, 0 until
+        // two batches of edges were seen.
+        std::atomic<int64_t> period_ns{0};
+    };
+
+    void Run();
+
+    std::unique_ptr<EdgeSource> source_;
+    size_t channel_count_;
+    Channel channels_[kMaxChannels];
+
+    std::thread thread_;
+
+    DISALLOW_COPY_AND_ASSIGN(EncoderMonitor);
+};
+
+}  // namespace smartcard
+
+#endif  // SRC_SMARTCARD_ENCODER_MONITOR_H_
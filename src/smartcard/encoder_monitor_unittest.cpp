@@ -0,0 +1,125 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+#include <base/time/time.h>
+#include <gtest/gtest.h>
+
+#include "edge_source.h"
+#include "encoder_monitor.h"
+
+namespace smartcard {
+
+namespace {
+
+const size_t kChannelCount = 4;
+const base::TimeDelta kWaitTimeout = base::TimeDelta::FromSeconds(1);
+
+// Edge timestamps are on the source's own clock; start well clear of 0,
+// which EncoderMonitor treats as "no edge yet".
+const int64_t kEdgeEpochNs = 1000000000LL;
+// Spacing between injected edges: 100ms is 10 ticks or 10000 milli-ticks
+// per second, and slow enough that a snapshot taken right after a batch
+// is not yet decayed.
+const int64_t kEdgeIntervalNs = 100000000LL;
+const int32_t kMilliTicksPerSecond = 10000;
+
+class EncoderMonitorTest : public testing::Test {
+ protected:
+    void SetUp() override {
+        source_ = new FakeEdgeSource{kChannelCount};
+        monitor_.reset(
+            new EncoderMonitor{std::unique_ptr<EdgeSource>{source_}});
+        ASSERT_TRUE(monitor_->Start());
+    }
+
+    // Waits until the monitor thread has counted |ticks| on |channel|.
+    bool WaitForTicks(size_t channel, int64_t ticks) {
+        base::TimeTicks deadline = base::TimeTicks::Now() + kWaitTimeout;
+        while (true) {
+            monitor_->GetSnapshot(&ticks_, &speeds_);
+            if (ticks_[channel] >= ticks)
+                return ticks_[channel] == ticks;
+            if (base::TimeTicks::Now() > deadline)
+                return false;
+            usleep(1000);
+        }
+    }
+
+    FakeEdgeSource* source_;  // owned by |monitor_|
+    std::unique_ptr<EncoderMonitor> monitor_;
+    std::vector<int64_t> ticks_;
+    std::vector<int32_t> speeds_;
+};
+
+}  // namespace
+
+TEST_F(EncoderMonitorTest, CountsEveryEdgeOfABurst) {
+    source_->Inject(0, 5, kEdgeEpochNs);
+    source_->Inject(2, 3, kEdgeEpochNs);
+    ASSERT_TRUE(WaitForTicks(0, 5));
+    ASSERT_TRUE(WaitForTicks(2, 3));
+
+    // More than the kernel's 16-event line queue in one wakeup.
+    source_->Inject(0, 40, kEdgeEpochNs + 40 * kEdgeIntervalNs);
+    ASSERT_TRUE(WaitForTicks(0, 45));
+
+    ASSERT_EQ(kChannelCount, ticks_.size());
+    EXPECT_EQ(45, ticks_[0]);
+    EXPECT_EQ(0, ticks_[1]);
+    EXPECT_EQ(3, ticks_[2]);
+    EXPECT_EQ(0, ticks_[3]);
+}
+
+TEST_F(EncoderMonitorTest, SpeedFollowsEdgeTimestamps) {
+    source_->Inject(1, 1, kEdgeEpochNs);
+    ASSERT_TRUE(WaitForTicks(1, 1));
+    // One batch gives no interval to measure yet.
+    EXPECT_EQ(0, speeds_[1]);
+
+    // Ten edges spread over a second, however late they are picked up.
+    source_->Inject(1, 10, kEdgeEpochNs + 10 * kEdgeIntervalNs);
+    ASSERT_TRUE(WaitForTicks(1, 11));
+    EXPECT_LE(speeds_[1], kMilliTicksPerSecond);
+    EXPECT_GT(speeds_[1], kMilliTicksPerSecond * 9 / 10);
+    EXPECT_EQ(0, speeds_[0]);
+}
+
+TEST_F(EncoderMonitorTest, SpeedDecaysOnceEdgesStop) {
+    source_->Inject(3, 1, kEdgeEpochNs);
+    ASSERT_TRUE(WaitForTicks(3, 1));
+    source_->Inject(3, 10, kEdgeEpochNs + 10 * kEdgeIntervalNs);
+    ASSERT_TRUE(WaitForTicks(3, 11));
+
+    // Three periods without an edge: at most a third of the speed is left.
+    usleep(3 * kEdgeIntervalNs / 1000);
+    monitor_->GetSnapshot(&ticks_, &speeds_);
+    EXPECT_EQ(11, ticks_[3]);
+    EXPECT_GT(speeds_[3], 0);
+    EXPECT_LE(speeds_[3], kMilliTicksPerSecond / 3);
+}
+
+TEST(EncoderMonitorStartTest, RejectsSourcesWithTooManyChannels) {
+    EncoderMonitor monitor{std::unique_ptr<EdgeSource>{
+        new FakeEdgeSource{EncoderMonitor::kMaxChannels + 1}}};
+    EXPECT_FALSE(monitor.Start());
+}
+
+}  // namespace smartcard
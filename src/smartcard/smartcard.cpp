@@ -16,6 +16,15 @@
 
 #include <sysexits.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+
 #include <base/bind.h>
 #include <base/command_line.h>
 #include <base/macros.h>
@@ -25,6 +34,12 @@
 #include <brillo/syslog_logging.h>
 
 #include "binder_constants.h"
+#include "deadman.h"
+#include "edge_source.h"
+#include "encoder_monitor.h"
+#include "flight_recorder.h"
+#include "metrics.h"
+#include "twist_mixer.h"
 #include "yudatun/product/smartcar/BnSmartCarService.h"
 #include "wheels.h"
 
@@ -32,52 +47,332 @@ using android::String16;
 
 namespace smartcard {
 
+namespace {
+const char kFlightRecorderPath[] = "/data/misc/smartcar/smartcard.flight";
+const char kMetricsSocketPath[] = "/data/misc/smartcar/smartcard.metrics";
+
+// Binder methods with their own latency histogram, in kMethodNames order.
+enum Method {
+    kGetAllWheelNames,
+    kGetAllWheelPins,
+    kGetAllWheelStatus,
+    kGetWheelCount,
+    kSetWheelStatus,
+    kGetWheelStatus,
+    kSetAllWheels,
+    kSetWheels,
+    kSetTwist,
+    kRenewLease,
+    kGetOdometry,
+    kDumpFlightRecorder,
+    kMethodCount,
+};
+
+const char* const kMethodNames[kMethodCount] = {
+    "getAllWheelNames",
+    "getAllWheelPins",
+    "getAllWheelStatus",
+    "getWheelCount",
+    "setWheelStatus",
+    "getWheelStatus",
+    "setAllWheels",
+    "setWheels",
+    "setTwist",
+    "renewLease",
+    "getOdometry",
+    "dumpFlightRecorder",
+};
+
+// How long freshly exported GPIOs get to show up in sysfs.
+const int kGpioAttributesTimeoutSeconds = 5;
+// Pause between failed hardware bring-up attempts.
+const int kBringUpRetrySeconds = 5;
+}  // namespace
+
 // SmartCarService
 class SmartCarService : public yudatun::product::smartcar::BnSmartCarService {
   public:
+    SmartCarService() {
+        for (const std::string& name : wheels_.GetWheelNames()) {
+            wheel_names_.push_back(String16{name.c_str()});
+        }
+
+        MetricsRegistry* metrics = MetricsRegistry::Get();
+        for (int i = 0; i < kMethodCount; ++i) {
+            latency_[i] = metrics->AddHistogram(
+                "smartcard_binder_call_latency_seconds",
+                "Time spent serving a binder call, including the wait "
+                "for hardware bring-up.",
+                std::string{"method=\""} + kMethodNames[i] + "\"");
+        }
+        errors_ = metrics->AddCounter(
+            "smartcard_binder_errors_total",
+            "Binder calls that returned an exception.");
+    }
+
+    ~SmartCarService() {
+        {
+            std::lock_guard<std::mutex> lock{bring_up_mutex_};
+            quit_ = true;
+        }
+        bring_up_cond_.notify_one();
+        if (bring_up_thread_.joinable())
+            bring_up_thread_.join();
+    }
+
+    // Brings the hardware up on background threads so that the service
+    // can be registered right away. Calls that touch the wheel GPIOs block
+    // until the first bring-up attempt is done, odometry on
+    // |encoders_ready_|. The encoders come up on their own: without them
+    // the car still drives.
+    void Init(base::TimeTicks daemon_start) {
+        first_attempt_ = first_attempt_done_.get_future().share();
+        bring_up_thread_ = std::thread(
+            &SmartCarService::BringUpHardware, this, daemon_start);
+        encoders_ready_ = std::async(std::launch::async, [this]() {
+            return StartEncoders();
+        }).share();
+    }
+
     android::binder::Status getAllWheelNames(
         std::vector<String16>* wheels) override {
-        std::vector<std::string> wheelNames = wheels_.GetWheelNames();
-        for (const std::string& name : wheelNames) {
-            wheels->push_back(String16{name.c_str()});
-        }
+        ScopedLatency latency{latency_[kGetAllWheelNames]};
+        *wheels = wheel_names_;
         return android::binder::Status::ok();
     }
 
     android::binder::Status getAllWheelPins(
         std::vector<int>* wheels) override {
+        ScopedLatency latency{latency_[kGetAllWheelPins]};
         *wheels = wheels_.GetWheelPins();
         return android::binder::Status::ok();
     }
 
     android::binder::Status getAllWheelStatus(
         std::vector<bool>* wheels) override {
+        ScopedLatency latency{latency_[kGetAllWheelStatus]};
         *wheels = wheels_.GetWheelStatus();
         return android::binder::Status::ok();
     }
 
     android::binder::Status getWheelCount(int32_t* count) override {
+        ScopedLatency latency{latency_[kGetWheelCount]};
         *count = wheels_.GetWheelCount();
         return android::binder::Status::ok();
     }
 
     android::binder::Status setWheelStatus(int pin, bool on) override {
-        wheels_.SetWheelStatus(pin, on);
-        return android::binder::Status::ok();
+        ScopedLatency latency{latency_[kSetWheelStatus]};
+        if (!IsHardwareReady())
+            return HardwareUnavailable();
+        return WriteWheels(on, [this, pin, on]() {
+            wheels_.SetWheelStatus(pin, on);
+        });
     }
 
     android::binder::Status getWheelStatus(int pin, bool *on) override {
+        ScopedLatency latency{latency_[kGetWheelStatus]};
+        if (!IsHardwareReady())
+            return HardwareUnavailable();
         *on = wheels_.IsWheelOn(pin);
         return android::binder::Status::ok();
     }
 
     android::binder::Status setAllWheels(bool on) override {
-        wheels_.SetAllWheels(on);
+        ScopedLatency latency{latency_[kSetAllWheels]};
+        if (!IsHardwareReady())
+            return HardwareUnavailable();
+        return WriteWheels(on, [this, on]() { wheels_.SetAllWheels(on); });
+    }
+
+    android::binder::Status setWheels(int32_t on_mask) override {
+        ScopedLatency latency{latency_[kSetWheels]};
+        uint32_t all_wheels = (1u << wheels_.GetWheelCount()) - 1;
+        if (static_cast<uint32_t>(on_mask) & ~all_wheels) {
+            return Error(android::binder::Status::EX_ILLEGAL_ARGUMENT, 0,
+                         "mask has bits for wheels that do not exist");
+        }
+        if (!IsHardwareReady())
+            return HardwareUnavailable();
+        return WriteWheels(on_mask != 0, [this, on_mask]() {
+            wheels_.SetWheels(on_mask);
+        });
+    }
+
+    android::binder::Status setTwist(float linear, float angular) override {
+        ScopedLatency latency{latency_[kSetTwist]};
+        if (std::isnan(linear) || std::isnan(angular)) {
+            return Error(android::binder::Status::EX_ILLEGAL_ARGUMENT, 0,
+                         "twist must be a number");
+        }
+        if (!IsHardwareReady())
+            return HardwareUnavailable();
+        uint32_t on_mask = mixer_.Mix(ToQ15(linear), ToQ15(angular));
+        return WriteWheels(on_mask != 0, [this, on_mask]() {
+            wheels_.SetWheels(on_mask);
+        });
+    }
+
+    android::binder::Status renewLease(int timeout_ms) override {
+        ScopedLatency latency{latency_[kRenewLease]};
+        if (timeout_ms < 0) {
+            return Error(android::binder::Status::EX_ILLEGAL_ARGUMENT, 0,
+                         "negative lease timeout");
+        }
+        if (!IsHardwareReady())
+            return HardwareUnavailable();
+        SyncAfterDeadmanTrip();
+        deadman_.Renew(base::TimeDelta::FromMilliseconds(timeout_ms));
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status getOdometry(
+        std::vector<int64_t>* ticks, std::vector<int32_t>* speeds,
+        int64_t* timestamp_ns) override {
+        ScopedLatency latency{latency_[kGetOdometry]};
+        if (!encoders_ready_.get()) {
+            return Error(android::binder::Status::EX_UNSUPPORTED_OPERATION, 0,
+                         "wheel encoders are not available");
+        }
+        *timestamp_ns = encoders_->GetSnapshot(ticks, speeds);
+        return android::binder::Status::ok();
+    }
+
+    android::binder::Status dumpFlightRecorder() override {
+        ScopedLatency latency{latency_[kDumpFlightRecorder]};
+        FlightRecorder* recorder = FlightRecorder::Get();
+        if (!recorder->DumpToFile(recorder->dump_path())) {
+            return Error(android::binder::Status::EX_ILLEGAL_STATE, 0,
+                         "failed to write flight recorder dump");
+        }
         return android::binder::Status::ok();
     }
 
   private:
+    // Slow boards may need longer than one attempt for the GPIOs to show
+    // up, so keep trying rather than failing every call until a restart.
+    void BringUpHardware(base::TimeTicks daemon_start) {
+        bool wheels_ready = false;
+        for (int attempt = 1;; ++attempt) {
+            wheels_ready = wheels_ready || wheels_.Init(
+                base::TimeDelta::FromSeconds(kGpioAttributesTimeoutSeconds));
+            bool ready = wheels_ready && deadman_.Start();
+            hardware_ready_.store(ready);
+            if (attempt == 1)
+                first_attempt_done_.set_value();
+            if (ready) {
+                LOG(INFO) << "Startup: hardware ready on attempt " << attempt
+                          << ", " << (base::TimeTicks::Now() - daemon_start)
+                          << " after daemon start";
+                return;
+            }
+            LOG(ERROR) << "Startup: hardware FAILED on attempt " << attempt
+                       << ", retrying in " << kBringUpRetrySeconds << "s";
+
+            std::unique_lock<std::mutex> lock{bring_up_mutex_};
+            if (bring_up_cond_.wait_for(
+                    lock, std::chrono::seconds(kBringUpRetrySeconds),
+                    [this]() { return quit_; })) {
+                return;
+            }
+        }
+    }
+
+    bool IsHardwareReady() const {
+        first_attempt_.wait();
+        return hardware_ready_.load();
+    }
+
+    bool StartEncoders() {
+        const std::vector<int> kEncoderPins = {
+            kLeftFrontEncoderPin,
+            kRightFrontEncoderPin,
+            kLeftAfterEncoderPin,
+            kRightAfterEncoderPin,
+        };
+        std::unique_ptr<GpioLineEdgeSource> source{new GpioLineEdgeSource};
+        if (!source->Open(kEncoderGpioChip, kEncoderPins)) {
+            LOG(WARNING) << "Wheel encoders unavailable";
+            return false;
+        }
+        encoders_.reset(new EncoderMonitor{std::move(source)});
+        return encoders_->Start();
+    }
+
+    static int32_t ToQ15(float value) {
+        value = std::max(-1.0f, std::min(1.0f, value));
+        return static_cast<int32_t>(value * 32767.0f);
+    }
+
+    android::binder::Status Error(
+        int32_t exception_code, int pin, const char* message) {
+        errors_->Increment();
+        FlightRecorder::Get()->Record(
+            FlightEvent::kBinderError, pin, exception_code);
+        return android::binder::Status::fromExceptionCode(
+            exception_code, android::String8{message});
+    }
+
+    android::binder::Status HardwareUnavailable() {
+        return Error(android::binder::Status::EX_ILLEGAL_STATE, 0,
+                     "wheel GPIOs are not available");
+    }
+
+    // The deadman thread writes the GPIOs behind our back; bring the cached
+    // wheel state back in line before honouring the next command.
+    void SyncAfterDeadmanTrip() {
+        if (!deadman_.ConsumeTrip())
+            return;
+        LOG(WARNING) << "Lease had expired, worst stop latency so far: "
+                     << deadman_.GetWorstStopLatency();
+        wheels_.SetAllWheels(false);
+    }
+
+    // Runs |write| against the deadman. Once the lease has expired no
+    // wheel may come on again before renewLease() re-arms it, and a write
+    // that lands just after a stop is undone here, since nothing else
+    // would ever stop that wheel again.
+    template <typename WheelWrite>
+    android::binder::Status WriteWheels(bool turns_on, WheelWrite write) {
+        uint64_t trips = deadman_.GetTripCount();
+        SyncAfterDeadmanTrip();
+        if (turns_on && deadman_.IsStopped()) {
+            return Error(android::binder::Status::EX_ILLEGAL_STATE, 0,
+                         "lease expired, renew it before driving");
+        }
+        write();
+        if (deadman_.GetTripCount() != trips) {
+            wheels_.SetAllWheels(false);
+            if (turns_on) {
+                return Error(android::binder::Status::EX_ILLEGAL_STATE, 0,
+                             "lease expired while driving");
+            }
+        }
+        return android::binder::Status::ok();
+    }
+
     Wheels wheels_;
+    // String16 shares its buffer on copy, so replies only copy the vector.
+    std::vector<String16> wheel_names_;
+    Deadman deadman_{wheels_.GetWheelPins()};
+    TwistMixer mixer_{wheels_.GetWheelPins()};
+    // Only read once |encoders_ready_| is done.
+    std::unique_ptr<EncoderMonitor> encoders_;
+
+    // Calls that touch the wheel GPIOs wait for the first attempt; later
+    // ones only flip |hardware_ready_|.
+    std::promise<void> first_attempt_done_;
+    std::shared_future<void> first_attempt_;
+    std::atomic<bool> hardware_ready_{false};
+    std::thread bring_up_thread_;
+    std::mutex bring_up_mutex_;
+    std::condition_variable bring_up_cond_;
+    bool quit_{false};  // guarded by |bring_up_mutex_|
+    std::shared_future<bool> encoders_ready_;
+
+    // Owned by MetricsRegistry.
+    LatencyHistogram* latency_[kMethodCount];
+    Counter* errors_;
 };
 
 class SmartCarDaemon final : public brillo::Daemon {
@@ -90,20 +385,30 @@ class SmartCarDaemon final : public brillo::Daemon {
  private:
     brillo::BinderWatcher binder_watcher_;
     android::sp<SmartCarService> smartcar_service_;
+    MetricsServer metrics_server_;
 
     DISALLOW_COPY_AND_ASSIGN(SmartCarDaemon);
 };
 
 // SmartCarDaemon
 int SmartCarDaemon::OnInit() {
+    base::TimeTicks start = base::TimeTicks::Now();
+
     android::BinderWrapper::Create();
     if (!binder_watcher_.Init())
         return EX_OSERR;
 
     smartcar_service_ = new SmartCarService();
+    smartcar_service_->Init(start);
     android::BinderWrapper::Get()->RegisterService(
         smartcard::kBinderServiceName,
         smartcar_service_);
+    LOG(INFO) << "Startup: service registered "
+              << (base::TimeTicks::Now() - start) << " after daemon start";
+
+    // Metrics are nice to have, the car drives without them.
+    if (!metrics_server_.Start(kMetricsSocketPath))
+        PLOG(WARNING) << "Failed to serve metrics on " << kMetricsSocketPath;
     return brillo::Daemon::OnInit();
 }
 
@@ -113,6 +418,8 @@ int SmartCarDaemon::OnInit() {
 int main(int argc, char *argv[]) {
     base::CommandLine::Init(argc, argv);
     brillo::InitLog(brillo::kLogToSyslog | brillo::kLogHeader);
+    smartcard::FlightRecorder::Get()->InstallSignalHandlers(
+        smartcard::kFlightRecorderPath);
     smartcard::SmartCarDaemon daemon;
     return daemon.Run();
 }
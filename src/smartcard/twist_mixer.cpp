@@ -0,0 +1,71 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "binder_constants.h"
+#include "twist_mixer.h"
+
+namespace smartcard {
+
+namespace {
+
+const int32_t kQ15One = 1 << 15;
+
+// Speed, in steps, at or above which a wheel is switched on: half speed.
+const int kOnThreshold = TwistMixer::kSteps / 2;
+
+}  // namespace
+
+const int TwistMixer::kSteps;
+const size_t TwistMixer::kMaxWheels;
+
+TwistMixer::TwistMixer(const std::vector<int>& pins) {
+    for (int l = 0; l < kLevels; ++l) {
+        for (int a = 0; a < kLevels; ++a) {
+            int linear = l - kSteps;
+            int angular = a - kSteps;
+            // Positive angular turns left: the right side speeds up.
+            int left = std::max(-kSteps, std::min(kSteps, linear - angular));
+            int right = std::max(-kSteps, std::min(kSteps, linear + angular));
+
+            uint32_t on_mask = 0;
+            for (size_t i = 0; i < pins.size() && i < kMaxWheels; ++i) {
+                bool is_left = pins[i] == kLeftFrontWheelPin ||
+                               pins[i] == kLeftAfterWheelPin;
+                // The wheels have no direction line, so reverse is off.
+                if ((is_left ? left : right) >= kOnThreshold)
+                    on_mask |= 1u << i;
+            }
+            table_[l][a] = on_mask;
+        }
+    }
+}
+
+uint32_t TwistMixer::Mix(
+    int32_t linear_q15, int32_t angular_q15) const {
+    return table_[Quantize(linear_q15)][Quantize(angular_q15)];
+}
+
+int TwistMixer::Quantize(int32_t value_q15) {
+    value_q15 = std::max(-kQ15One, std::min(kQ15One, value_q15));
+    // Round to the nearest step, symmetrically around zero.
+    int32_t scaled = value_q15 * kSteps;
+    int step = (scaled + (scaled >= 0 ? kQ15One / 2 : -kQ15One / 2)) / kQ15One;
+    return step + kSteps;
+}
+
+}  // namespace smartcard
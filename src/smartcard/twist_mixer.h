@@ -0,0 +1,55 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_SMARTCARD_TWIST_MIXER_H_
+#define SRC_SMARTCARD_TWIST_MIXER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <base/macros.h>
+
+namespace smartcard {
+
+// Differential-drive mixer: turns a twist into on/off states for the left
+// and right wheel groups. Inputs are Q15 fractions of full scale. Both are
+// quantized to kSteps steps per direction and looked up in a table built
+// once, so mixing is two multiplies and an array index.
+class TwistMixer final {
+ public:
+    static const int kSteps = 8;
+    static const size_t kMaxWheels = 32;
+
+    explicit TwistMixer(const std::vector<int>& pins);
+
+    // Bit i is set if wheel i, indexed like |pins|, should be on.
+    uint32_t Mix(int32_t linear_q15, int32_t angular_q15) const;
+
+ private:
+    static const int kLevels = 2 * kSteps + 1;
+
+    static int Quantize(int32_t value_q15);
+
+    uint32_t table_[kLevels][kLevels];
+
+    DISALLOW_COPY_AND_ASSIGN(TwistMixer);
+};
+
+}  // namespace smartcard
+
+#endif  // SRC_SMARTCARD_TWIST_MIXER_H_
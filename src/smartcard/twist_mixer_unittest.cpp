@@ -0,0 +1,82 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "binder_constants.h"
+#include "twist_mixer.h"
+
+namespace smartcard {
+
+namespace {
+
+const int32_t kFull = 32767;
+
+// The smallest Q15 value that rounds to half speed, the on threshold:
+// 3.5 of 8 steps.
+const int32_t kHalfSpeed = 14336;
+
+// Wheel order of Wheels::GetWheelPins().
+const uint32_t kLeftFront = 1 << 0;
+const uint32_t kRightFront = 1 << 1;
+const uint32_t kLeftAfter = 1 << 2;
+const uint32_t kRightAfter = 1 << 3;
+const uint32_t kLeft = kLeftFront | kLeftAfter;
+const uint32_t kRight = kRightFront | kRightAfter;
+const uint32_t kAll = kLeft | kRight;
+
+class TwistMixerTest : public testing::Test {
+ protected:
+    TwistMixer mixer_{std::vector<int>{kLeftFrontWheelPin, kRightFrontWheelPin,
+                                       kLeftAfterWheelPin, kRightAfterWheelPin}};
+};
+
+}  // namespace
+
+TEST_F(TwistMixerTest, StraightLines) {
+    EXPECT_EQ(0u, mixer_.Mix(0, 0));
+    EXPECT_EQ(kAll, mixer_.Mix(kFull, 0));
+    // No direction line: reverse leaves every wheel off.
+    EXPECT_EQ(0u, mixer_.Mix(-kFull, 0));
+}
+
+TEST_F(TwistMixerTest, PositiveAngularTurnsLeft) {
+    EXPECT_EQ(kRight, mixer_.Mix(0, kFull));
+    EXPECT_EQ(kLeft, mixer_.Mix(0, -kFull));
+    EXPECT_EQ(kRight, mixer_.Mix(kFull, kFull));
+}
+
+TEST_F(TwistMixerTest, ClampsInputsAndSides) {
+    EXPECT_EQ(kAll, mixer_.Mix(4 * kFull, 0));
+    EXPECT_EQ(0u, mixer_.Mix(-4 * kFull, 0));
+    EXPECT_EQ(kRight, mixer_.Mix(0, 4 * kFull));
+    // Full linear plus full angular saturates the right side at full
+    // speed rather than overflowing into the left.
+    EXPECT_EQ(mixer_.Mix(kFull, kFull), mixer_.Mix(4 * kFull, 4 * kFull));
+}
+
+TEST_F(TwistMixerTest, RoundsToNearestStepAgainstTheOnThreshold) {
+    EXPECT_EQ(kAll, mixer_.Mix(kHalfSpeed, 0));
+    EXPECT_EQ(0u, mixer_.Mix(kHalfSpeed - 1, 0));
+
+    // Rounding is symmetric around zero.
+    EXPECT_EQ(kLeft, mixer_.Mix(0, -kHalfSpeed));
+    EXPECT_EQ(0u, mixer_.Mix(0, -(kHalfSpeed - 1)));
+}
+
+}  // namespace smartcard
@@ -14,22 +14,36 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <string>
 
 #include <base/bind.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
 #include <base/format_macros.h>
 #include <base/macros.h>
+#include <base/posix/eintr_wrapper.h>
 #include <base/strings/stringprintf.h>
-#include <base/strings/string_number_conversions.h>
-#include <base/strings/string_util.h>
 #include <brillo/streams/file_stream.h>
 #include <brillo/streams/stream_utils.h>
 
 #include "binder_constants.h"
+#include "flight_recorder.h"
 #include "wheels.h"
 
 namespace smartcard {
 
+// GPIO sysfs path
+const char* const kGPIOSysfsPath = "/sys/class/gpio";
+
+// Longest single wait for an attribute change before re-checking by hand
+const int kGpioRecheckIntervalMs = 5;
+
 Wheels::Wheels() {
     const std::initializer_list<const char*> kLogicalWheelss = {
         "left_front",
@@ -51,22 +65,52 @@ Wheels::Wheels() {
 
     for (int pin : kWheelsGpioPins) {
         wheel_pins_.push_back(pin);
-        ExportGpio(pin);
+        wheel_status_.push_back(false);
+    }
+}
+
+bool Wheels::Init(base::TimeDelta timeout) {
+    base::TimeTicks start = base::TimeTicks::Now();
+
+    if (!ExportGpios())
+        return false;
+    base::TimeTicks exported = base::TimeTicks::Now();
+
+    if (!WaitForGpioAttributes(timeout)) {
+        LOG(ERROR) << "Timed out waiting for GPIO attributes";
+        return false;
+    }
+    base::TimeTicks attributes_ready = base::TimeTicks::Now();
+
+    for (int pin : wheel_pins_) {
         WriteGpio(pin, "direction", "out");
         WriteGpio(pin, "value", "0");
-        wheel_status_.push_back(false);
     }
+    if (!OpenValueFiles())
+        return false;
+    base::TimeTicks configured = base::TimeTicks::Now();
+
+    LOG(INFO) << "Wheels startup: export " << (exported - start)
+              << ", attributes " << (attributes_ready - exported)
+              << ", configure " << (configured - attributes_ready)
+              << ", total " << (configured - start);
+    return true;
+}
+
+Wheels::~Wheels() {
+    for (int fd : value_fds_)
+        IGNORE_EINTR(close(fd));
 }
 
-std::vector<std::string> Wheels::GetWheelNames() const {
+const std::vector<std::string>& Wheels::GetWheelNames() const {
     return wheel_names_;
 }
 
-std::vector<int> Wheels::GetWheelPins() const {
+const std::vector<int>& Wheels::GetWheelPins() const {
     return wheel_pins_;
 }
 
-std::vector<bool> Wheels::GetWheelStatus() const {
+const std::vector<bool>& Wheels::GetWheelStatus() const {
     return wheel_status_;
 }
 
@@ -75,28 +119,27 @@ size_t Wheels::GetWheelCount() const {
 }
 
 bool Wheels::IsWheelOn(int pin) const {
-    std::string value;
-    if (!ReadGpio(pin, "value", value)) {
+    int index = GetWheelIndex(pin);
+    if (index < 0 || static_cast<size_t>(index) >= value_fds_.size()) {
         return false;
     }
-    int v = 0;
-    if (!base::StringToInt(value, &v)) {
+    char value = '0';
+    if (HANDLE_EINTR(pread(value_fds_[index], &value, 1, 0)) != 1) {
         return false;
     }
-    return v > 0;
+    return value == '1';
 }
 
 void Wheels::SetWheelStatus(int pin, bool on) {
-    std::string value = on ? "1" : "0";
-    if (!WriteGpio(pin, "value", value)) {
+    int index = GetWheelIndex(pin);
+    if (index < 0 || static_cast<size_t>(index) >= value_fds_.size()) {
         return;
     }
-    for (size_t i = 0; i < GetWheelCount(); ++i) {
-        if (pin == wheel_pins_[i]) {
-            wheel_status_[i] = on;
-            break;
-        }
+    if (HANDLE_EINTR(pwrite(value_fds_[index], on ? "1" : "0", 1, 0)) != 1) {
+        return;
     }
+    FlightRecorder::Get()->Record(FlightEvent::kWheelWrite, pin, on);
+    wheel_status_[index] = on;
 }
 
 void Wheels::SetAllWheels(bool on) {
@@ -105,17 +148,85 @@ void Wheels::SetAllWheels(bool on) {
     }
 }
 
+void Wheels::SetWheels(uint32_t on_mask) {
+    for (size_t i = 0; i < GetWheelCount(); ++i) {
+        bool on = (on_mask & (1u << i)) != 0;
+        if (wheel_status_[i] != on)
+            SetWheelStatus(wheel_pins_[i], on);
+    }
+}
+
 // Private Functions
-bool Wheels::ExportGpio(int pin) const {
-    brillo::StreamPtr stream = GetGpioExportStream(true);
-    if (!stream) {
-        return false;
+bool Wheels::ExportGpios() const {
+    brillo::StreamPtr stream;
+    for (int pin : wheel_pins_) {
+        if (base::DirectoryExists(GetGpioPath(pin)))
+            continue;
+        // Every pin goes through the same open export file, one write each.
+        if (!stream) {
+            stream = GetGpioExportStream(true);
+            if (!stream) {
+                return false;
+            }
+        }
+        std::string value = base::StringPrintf("%d", pin);
+        stream->WriteAllBlocking(value.data(), value.size(), nullptr);
     }
-    std::string value = base::StringPrintf("%d", pin);
-    stream->WriteAllBlocking(value.data(), value.size(), nullptr);
     return true;
 }
 
+/*
+ * Wait until the attributes of every wheel pin are writable
+ * base::TimeDelta timeout: give up after this long
+ * return: true if all attributes are ready
+ *
+ * udev creates and chowns the gpioN attribute files some time after the
+ * export write returns, so watch for that rather than failing on the
+ * first open. inotify wakes us as soon as something changes; each wait is
+ * still capped at kGpioRecheckIntervalMs so a chmod that inotify misses
+ * (e.g. on a directory that did not exist when we added the watch) only
+ * costs a few milliseconds instead of the whole timeout.
+ */
+bool Wheels::WaitForGpioAttributes(base::TimeDelta timeout) const {
+    base::ScopedFD inotify_fd{inotify_init1(IN_CLOEXEC | IN_NONBLOCK)};
+    if (!inotify_fd.is_valid()) {
+        PLOG(ERROR) << "inotify_init1 failed";
+        return false;
+    }
+    inotify_add_watch(inotify_fd.get(), kGPIOSysfsPath, IN_CREATE);
+
+    base::TimeTicks deadline = base::TimeTicks::Now() + timeout;
+    while (true) {
+        bool ready = true;
+        for (int pin : wheel_pins_) {
+            base::FilePath gpio_path = GetGpioPath(pin);
+            // Watching an already watched path just returns the old
+            // descriptor, so re-adding on every pass is harmless.
+            inotify_add_watch(inotify_fd.get(), gpio_path.value().c_str(),
+                              IN_CREATE | IN_ATTRIB);
+            for (const char* type : {"direction", "value"}) {
+                if (access(gpio_path.Append(type).value().c_str(), W_OK) != 0)
+                    ready = false;
+            }
+        }
+        if (ready)
+            return true;
+
+        base::TimeDelta remaining = deadline - base::TimeTicks::Now();
+        if (remaining <= base::TimeDelta())
+            return false;
+
+        int wait_ms = std::min<int64_t>(remaining.InMilliseconds() + 1,
+                                        kGpioRecheckIntervalMs);
+        struct pollfd pfd = {inotify_fd.get(), POLLIN, 0};
+        if (HANDLE_EINTR(poll(&pfd, 1, wait_ms)) > 0) {
+            char events[4096];
+            while (read(inotify_fd.get(), events, sizeof(events)) > 0) {
+            }
+        }
+    }
+}
+
 bool Wheels::WriteGpio(
     int pin, const std::string& type, const std::string& v) const {
     brillo::StreamPtr stream = GetGpioDataStream(pin, type, true);
@@ -126,27 +237,30 @@ bool Wheels::WriteGpio(
     return true;
 }
 
-bool Wheels::ReadGpio(int pin, const std::string& type, std::string& v) const {
-    brillo::StreamPtr stream = GetGpioDataStream(pin, type, false);
-    if (!stream) {
-        return false;
-    }
-
-    char buffer[10];
-    size_t size_read = 0;
-    if (!stream->ReadNonBlocking(
-            buffer, sizeof (buffer), &size_read, nullptr, nullptr)) {
-        return false;
+bool Wheels::OpenValueFiles() {
+    for (int pin : wheel_pins_) {
+        base::FilePath path = GetGpioPath(pin).Append("value");
+        int fd = HANDLE_EINTR(open(path.value().c_str(), O_RDWR | O_CLOEXEC));
+        if (fd < 0) {
+            PLOG(ERROR) << "Failed to open " << path.value();
+            // Leave nothing half open for the next Init() attempt.
+            for (int open_fd : value_fds_)
+                IGNORE_EINTR(close(open_fd));
+            value_fds_.clear();
+            return false;
+        }
+        value_fds_.push_back(fd);
     }
-
-    v.insert(0, buffer, size_read);
-    base::TrimWhitespaceASCII(v, base::TrimPositions::TRIM_ALL, &v);
-
     return true;
 }
 
-// GPIO sysfs path
-const char* const kGPIOSysfsPath = "/sys/class/gpio";
+int Wheels::GetWheelIndex(int pin) const {
+    for (size_t i = 0; i < wheel_pins_.size(); ++i) {
+        if (pin == wheel_pins_[i])
+            return i;
+    }
+    return -1;
+}
 
 /*
  * Get a file stream for GPIO export
@@ -172,13 +286,21 @@ brillo::StreamPtr Wheels::GetGpioExportStream(bool write) const {
  */
 brillo::StreamPtr Wheels::GetGpioDataStream(
     int pin, const std::string& type, bool write) const {
-    std::string gpio_path;
-    gpio_path = base::StringPrintf("%s/gpio%d/%s", kGPIOSysfsPath, pin, type.c_str());
-    base::FilePath dev_path{gpio_path};
+    base::FilePath dev_path = GetGpioPath(pin).Append(type);
     auto access_mode = brillo::stream_utils::MakeAccessMode(!write, write);
     return brillo::FileStream::Open(
         dev_path, access_mode, brillo::FileStream::Disposition::OPEN_EXISTING,
         nullptr);
 }
 
+/*
+ * Get the sysfs directory of a GPIO
+ * int gpio: GPIO pin number
+ * return: e.g. /sys/class/gpio/gpio11
+ */
+base::FilePath Wheels::GetGpioPath(int pin) const {
+    return base::FilePath{
+        base::StringPrintf("%s/gpio%d", kGPIOSysfsPath, pin)};
+}
+
 }  // namespace smartcard
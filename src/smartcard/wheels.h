@@ -17,10 +17,14 @@
 #ifndef SRC_SMARTCARD_WHEELS_H_
 #define SRC_SMARTCARD_WHEELS_H_
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
+#include <base/files/file_path.h>
 #include <base/macros.h>
+#include <base/time/time.h>
 #include <brillo/streams/file_stream.h>
 
 namespace smartcard {
@@ -28,10 +32,16 @@ namespace smartcard {
 class Wheels final {
  public:
     Wheels();
+    ~Wheels();
+
+    // Exports and configures the wheel GPIOs as outputs. Waits up to
+    // |timeout| for the sysfs attributes of freshly exported pins to
+    // become writable.
+    bool Init(base::TimeDelta timeout);
 
-    std::vector<std::string> GetWheelNames() const;
-    std::vector<int> GetWheelPins() const;
-    std::vector<bool> GetWheelStatus() const;
+    const std::vector<std::string>& GetWheelNames() const;
+    const std::vector<int>& GetWheelPins() const;
+    const std::vector<bool>& GetWheelStatus() const;
 
     size_t GetWheelCount() const;
 
@@ -39,11 +49,18 @@ class Wheels final {
     void SetWheelStatus(int pin, bool on);
     void SetAllWheels(bool on);
 
+    // Switches wheel i on if bit i of |on_mask| is set, off otherwise.
+    // Only wheels whose state changes are written.
+    void SetWheels(uint32_t on_mask);
+
  private:
-    bool ExportGpio(int pin) const;
+    bool ExportGpios() const;
+    bool WaitForGpioAttributes(base::TimeDelta timeout) const;
     bool WriteGpio(int pin, const std::string& type, const std::string& v) const;
-    bool ReadGpio(int pin, const std::string& type, std::string& v) const;
+    bool OpenValueFiles();
+    int GetWheelIndex(int pin) const;
 
+    base::FilePath GetGpioPath(int pin) const;
     brillo::StreamPtr GetGpioExportStream(bool write) const;
     brillo::StreamPtr GetGpioDataStream(
         int pin, const std::string& type, bool write) const;
@@ -52,6 +69,10 @@ class Wheels final {
     std::vector<int> wheel_pins_;
     std::vector<bool> wheel_status_;
 
+    // Value files kept open after Init() so that switching a wheel is a
+    // single pwrite(), with no path formatting or stream set-up.
+    std::vector<int> value_fds_;
+
     DISALLOW_COPY_AND_ASSIGN(Wheels);
 };
 